@@ -0,0 +1,450 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "executor.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <Poco/Exception.h>
+#include <Poco/Logger.h>
+
+#include <exception>
+#include <iostream>
+
+
+namespace
+{
+	// Worker Thread Info, used to post jobs from a worker thread to its own queue
+	struct WorkerInfo {
+		const Executor *executor;
+		std::size_t index;
+	};
+	boost::thread_specific_ptr<WorkerInfo> current_worker;
+
+	void logJobError(const std::string &error)
+	{
+		#ifdef TESTING
+			std::cout << "extDB: Worker Job Error: " << error << std::endl;
+		#endif
+		Poco::Logger::get("extDB").error("Worker Job Error: " + error);
+	}
+}
+
+
+Executor::Executor() : next_sequence(0), pending_jobs(0), active_jobs(0), completed_jobs(0), sleeping_workers(0), running(false)
+{
+}
+
+
+Executor::~Executor()
+{
+	stop();
+}
+
+
+void Executor::start(const int &num_of_threads)
+{
+	running = true;
+	injection_queue.size = 0;
+	for (int i = 0; i < num_of_threads; ++i)
+	{
+		boost::shared_ptr<WorkerQueue> worker_queue(new WorkerQueue());
+		worker_queue->size = 0;
+		worker_queues.push_back(worker_queue);
+	}
+	for (int i = 0; i < num_of_threads; ++i)
+	{
+		worker_threads.create_thread(boost::bind(&Executor::run, this, i));
+	}
+}
+
+
+void Executor::post(const Job &job)
+{
+	WorkerQueue *worker_queue = &injection_queue;
+	WorkerInfo *worker_info = current_worker.get();
+	if ((worker_info != NULL) && (worker_info->executor == this))
+	{
+		worker_queue = worker_queues[worker_info->index].get();
+	}
+
+	{
+		boost::lock_guard<boost::mutex> lock(worker_queue->mutex);
+		// Taken under queue lock, so sequence order matches order inside each queue
+		QueuedJob queued_job;
+		queued_job.sequence = next_sequence.fetch_add(1, boost::memory_order_relaxed);
+		worker_queue->jobs.push_back(queued_job);
+		worker_queue->jobs.back().job = job;
+		++(worker_queue->size);
+	}
+	++pending_jobs;
+
+	// Only take sleep lock if a worker is waiting
+	if (sleeping_workers > 0)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_sleep);
+		cond_sleep.notify_one();
+	}
+}
+
+
+bool Executor::drain(const boost::chrono::steady_clock::time_point &deadline)
+// Worker Threads keep running jobs, jobs posted meanwhile (i.e from a worker) are also waited on
+{
+	while ((pending_jobs > 0) || (active_jobs > 0))
+	{
+		if (boost::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+	}
+	return true;
+}
+
+
+std::size_t Executor::stop()
+// Stops Worker Threads, Jobs still queued are dropped
+//   Running Jobs are finished first
+{
+	std::size_t dropped_jobs = 0;
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_sleep);
+		running = false;
+		cond_sleep.notify_all();
+	}
+	worker_threads.join_all();
+
+	{
+		boost::lock_guard<boost::mutex> lock(injection_queue.mutex);
+		dropped_jobs += injection_queue.jobs.size();
+		pending_jobs -= injection_queue.jobs.size();
+		injection_queue.jobs.clear();
+		injection_queue.size = 0;
+	}
+	for (std::vector< boost::shared_ptr<WorkerQueue> >::iterator it = worker_queues.begin(); it != worker_queues.end(); ++it)
+	{
+		boost::lock_guard<boost::mutex> lock((*it)->mutex);
+		dropped_jobs += (*it)->jobs.size();
+		pending_jobs -= (*it)->jobs.size();
+		(*it)->jobs.clear();
+		(*it)->size = 0;
+	}
+	return dropped_jobs;
+}
+
+
+std::size_t Executor::pending() const
+{
+	const int jobs = pending_jobs;
+	return (jobs > 0) ? jobs : 0;
+}
+
+
+std::size_t Executor::active() const
+{
+	const int jobs = active_jobs;
+	return (jobs > 0) ? jobs : 0;
+}
+
+
+std::size_t Executor::completed() const
+{
+	return completed_jobs;
+}
+
+
+std::size_t Executor::threads() const
+{
+	return worker_queues.size();
+}
+
+
+bool Executor::isWorkerThread()
+{
+	return (current_worker.get() != NULL);
+}
+
+
+bool Executor::popOldest(WorkerQueue &worker_queue, Job &job)
+// Older front job of injection queue + worker_queue, locks are always taken in that order
+{
+	WorkerQueue *oldest_queue = NULL;
+	boost::unique_lock<boost::mutex> injection_lock(injection_queue.mutex, boost::defer_lock);
+	if (injection_queue.size.load(boost::memory_order_relaxed) > 0)
+	{
+		injection_lock.lock();
+		if (!injection_queue.jobs.empty())
+		{
+			oldest_queue = &injection_queue;
+		}
+	}
+	boost::unique_lock<boost::mutex> worker_lock(worker_queue.mutex, boost::defer_lock);
+	if (worker_queue.size.load(boost::memory_order_relaxed) > 0)
+	{
+		worker_lock.lock();
+		if ((!worker_queue.jobs.empty()) && ((oldest_queue == NULL) || (worker_queue.jobs.front().sequence < oldest_queue->jobs.front().sequence)))
+		{
+			oldest_queue = &worker_queue;
+		}
+	}
+	if (oldest_queue == NULL)
+	{
+		return false;
+	}
+	job.swap(oldest_queue->jobs.front().job);
+	oldest_queue->jobs.pop_front();
+	--(oldest_queue->size);
+	++active_jobs;  // Before pending drops, so drain never sees both at 0 in between
+	--pending_jobs;
+	return true;
+}
+
+
+bool Executor::popJob(const std::size_t &worker_index, Job &job)
+// Own queue + injection queue first, then steal oldest job from other queues
+{
+	if (popOldest(*worker_queues[worker_index], job))
+	{
+		return true;
+	}
+	const std::size_t num_of_queues = worker_queues.size();
+	for (std::size_t i = 1; i < num_of_queues; ++i)
+	{
+		WorkerQueue &worker_queue = *worker_queues[(worker_index + i) % num_of_queues];
+		if (worker_queue.size.load(boost::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+		boost::lock_guard<boost::mutex> lock(worker_queue.mutex);
+		if (!worker_queue.jobs.empty())
+		{
+			job.swap(worker_queue.jobs.front().job);
+			worker_queue.jobs.pop_front();
+			--(worker_queue.size);
+			++active_jobs;
+			--pending_jobs;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void Executor::run(const std::size_t worker_index)
+{
+	WorkerInfo *worker_info = new WorkerInfo();
+	worker_info->executor = this;
+	worker_info->index = worker_index;
+	current_worker.reset(worker_info);
+
+	Job job;
+	int idle_spins = 0;
+	while (running)
+	{
+		if (popJob(worker_index, job))
+		{
+			// Job that throws must not end Worker Thread, active_jobs has to drop for drain()
+			try
+			{
+				job();
+			}
+			catch (Poco::Exception& e)
+			{
+				logJobError(e.displayText());
+			}
+			catch (std::exception& e)
+			{
+				logJobError(e.what());
+			}
+			catch (...)
+			{
+				logJobError("Unknown Exception");
+			}
+			job.clear();
+			++completed_jobs;
+			--active_jobs;
+			idle_spins = 0;
+		}
+		else if (idle_spins < 64)
+		// Short spin before sleeping, saves a wakeup when jobs arrive in bursts
+		{
+			++idle_spins;
+			boost::this_thread::yield();
+		}
+		else
+		{
+			idle_spins = 0;
+			boost::unique_lock<boost::mutex> lock(mutex_sleep);
+			++sleeping_workers;
+			while (running && (pending_jobs <= 0))
+			{
+				cond_sleep.wait(lock);
+			}
+			--sleeping_workers;
+		}
+	}
+}
+
+
+ConcurrencyLimiter::ConcurrencyLimiter(const int &max_concurrency) : running_jobs(0), max_concurrency(max_concurrency)
+{
+}
+
+
+bool ConcurrencyLimiter::acquire(const Executor::Job &job)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (running_jobs < max_concurrency)
+	{
+		++running_jobs;
+		return true;
+	}
+	waiting_jobs.push_back(job);
+	return false;
+}
+
+
+bool ConcurrencyLimiter::release(Executor::Job &next_job)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (waiting_jobs.empty())
+	{
+		--running_jobs;
+		return false;
+	}
+	next_job.swap(waiting_jobs.front());
+	waiting_jobs.pop_front();
+	return true;
+}
+
+
+std::size_t ConcurrencyLimiter::waiting()
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	return waiting_jobs.size();
+}
+
+
+#ifdef TEST_EXECUTOR_APP
+
+#include <boost/asio.hpp>
+#include <boost/chrono.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+// Compares jobs/sec + p99 enqueue-to-start latency, Executor versus boost::asio::io_service
+namespace
+{
+	typedef boost::chrono::high_resolution_clock Clock;
+
+	struct BenchmarkState {
+		std::vector<Clock::duration> latency;
+		boost::atomic<int> jobs_done;
+	};
+
+	void benchmarkJob(BenchmarkState *state, const std::size_t index, const Clock::time_point enqueued)
+	{
+		state->latency[index] = Clock::now() - enqueued;
+		// Small amount of work, similar to building a short result string
+		std::string result;
+		for (int i = 0; i < 16; ++i)
+		{
+			result += "[1, \"";
+		}
+		++(state->jobs_done);
+	}
+
+	void report(const std::string &name, const int &num_of_threads, const int &num_of_jobs, BenchmarkState &state, const Clock::duration &elapsed)
+	{
+		std::sort(state.latency.begin(), state.latency.end());
+		const double seconds = boost::chrono::duration_cast< boost::chrono::duration<double> >(elapsed).count();
+		const double p99_us = boost::chrono::duration_cast< boost::chrono::duration<double, boost::micro> >(state.latency[(state.latency.size() * 99) / 100]).count();
+		std::cout << std::setw(12) << name << " threads: " << std::setw(2) << num_of_threads;
+		std::cout << "  jobs/sec: " << std::setw(10) << static_cast<long long>(num_of_jobs / seconds);
+		std::cout << "  p99 enqueue-to-start: " << std::setw(10) << p99_us << " us" << std::endl;
+	}
+
+	void benchmarkExecutor(const int &num_of_threads, const int &num_of_jobs)
+	{
+		BenchmarkState state;
+		state.latency.resize(num_of_jobs);
+		state.jobs_done = 0;
+
+		Executor executor;
+		executor.start(num_of_threads);
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < num_of_jobs; ++i)
+		{
+			executor.post(boost::bind(&benchmarkJob, &state, i, Clock::now()));
+		}
+		while (state.jobs_done < num_of_jobs)
+		{
+			boost::this_thread::yield();
+		}
+		const Clock::duration elapsed = Clock::now() - start;
+		executor.stop();
+		report("Executor", num_of_threads, num_of_jobs, state, elapsed);
+	}
+
+	void benchmarkIOService(const int &num_of_threads, const int &num_of_jobs)
+	{
+		BenchmarkState state;
+		state.latency.resize(num_of_jobs);
+		state.jobs_done = 0;
+
+		boost::asio::io_service io_service;
+		boost::shared_ptr<boost::asio::io_service::work> io_work_ptr(new boost::asio::io_service::work(io_service));
+		boost::thread_group threads;
+		for (int i = 0; i < num_of_threads; ++i)
+		{
+			threads.create_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+		}
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < num_of_jobs; ++i)
+		{
+			io_service.post(boost::bind(&benchmarkJob, &state, i, Clock::now()));
+		}
+		while (state.jobs_done < num_of_jobs)
+		{
+			boost::this_thread::yield();
+		}
+		const Clock::duration elapsed = Clock::now() - start;
+		io_service.stop();
+		threads.join_all();
+		report("io_service", num_of_threads, num_of_jobs, state, elapsed);
+	}
+}
+
+
+int main(int nNumberofArgs, char* pszArgs[])
+{
+	const int num_of_jobs = 500000;
+	const int thread_counts[] = {1, 2, 4, 8, 16, 32};
+	for (std::size_t i = 0; i < (sizeof(thread_counts) / sizeof(thread_counts[0])); ++i)
+	{
+		benchmarkIOService(thread_counts[i], num_of_jobs);
+		benchmarkExecutor(thread_counts[i], num_of_jobs);
+	}
+	return 0;
+}
+#endif
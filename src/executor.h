@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+
+class Executor
+// Work Stealing Thread Pool, replaces boost::asio::io_service as job queue
+//   Jobs from arma main thread go to one shared injection queue, so they start in the order they were posted
+//   Jobs posted from a worker thread go to that workers own queue (no shared lock for follow up jobs)
+//   Each job gets a sequence number, a worker takes the older front job of injection queue + its own queue
+//   Idle workers then steal from other queues, always oldest job first
+{
+	public:
+		typedef boost::function<void()> Job;
+
+		Executor();
+		~Executor();
+
+		void start(const int &num_of_threads);
+		void post(const Job &job);
+		bool drain(const boost::chrono::steady_clock::time_point &deadline);  // Waits until no jobs are queued / running, false if deadline passed first
+		std::size_t stop();  // Returns count of queued jobs dropped
+
+		std::size_t pending() const;
+		std::size_t active() const;
+		std::size_t completed() const;
+		std::size_t threads() const;
+
+		static bool isWorkerThread();  // true if called from a Worker Thread of any Executor
+
+	private:
+		struct QueuedJob {
+			std::size_t sequence;
+			Job job;
+		};
+		struct WorkerQueue {
+			boost::mutex mutex;
+			std::deque<QueuedJob> jobs;
+			boost::atomic<std::size_t> size;  // Lets workers skip empty queues without locking
+			char padding[64];  // Keep queue locks on separate cache lines
+		};
+		WorkerQueue injection_queue;
+		std::vector< boost::shared_ptr<WorkerQueue> > worker_queues;
+		boost::thread_group worker_threads;
+
+		boost::atomic<std::size_t> next_sequence;
+		boost::atomic<int> pending_jobs;
+		boost::atomic<int> active_jobs;
+		boost::atomic<std::size_t> completed_jobs;
+		boost::atomic<int> sleeping_workers;
+		boost::atomic<bool> running;
+
+		boost::mutex mutex_sleep;
+		boost::condition_variable cond_sleep;
+
+		bool popOldest(WorkerQueue &worker_queue, Job &job);
+		bool popJob(const std::size_t &worker_index, Job &job);
+		void run(const std::size_t worker_index);
+};
+
+
+class ConcurrencyLimiter
+// Limits how many Jobs of one Protocol run at once
+//   Extra Jobs wait in here instead of the Executor queue, so they don't hold a Worker Thread while waiting
+{
+	public:
+		ConcurrencyLimiter(const int &max_concurrency);
+
+		bool acquire(const Executor::Job &job);   // true = run job now, false = job was queued
+		bool release(Executor::Job &next_job);    // true = next_job takes over the released slot
+
+		std::size_t waiting();
+
+	private:
+		boost::mutex mutex;
+		std::deque<Executor::Job> waiting_jobs;
+		int running_jobs;
+		int max_concurrency;
+};
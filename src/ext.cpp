@@ -24,6 +24,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <Poco/Data/MySQL/MySQLException.h>
 #include <Poco/Data/SQLite/Connector.h>
 #include <Poco/Data/SQLite/SQLiteException.h>
+#include <Poco/Data/SQLite/Utility.h>
 #include "Poco/Data/ODBC/Connector.h"
 #include "Poco/Data/ODBC/ODBCException.h"
 
@@ -46,19 +47,24 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <Poco/StringTokenizer.h>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/random/random_device.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/regex.hpp>
+#include <boost/utility/string_ref.hpp>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <iterator>
 
+#include <sqlite3.h>
+
+#include "output_writer.h"
+#include "protocol_registry.h"
 #include "uniqueid.h"
 
 #include "protocols/abstract_protocol.h"
@@ -73,10 +79,152 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "protocols/db_raw_no_extra_quotes_v2.h"
 #include "protocols/log.h"
 #include "protocols/misc.h"
+#include "protocols/native_mysql.h"
+
+
+DBPool::DBPool(const std::string& sessionKey, const std::string& connectionString, int minSessions, int maxSessions, int idleTime, int maxWait): 
+	Poco::Data::SessionPool(sessionKey, connectionString, minSessions, maxSessions, idleTime),
+	pending_gets(0), min_sessions(minSessions), max_sessions(maxSessions), max_wait(maxWait),
+	soft_cap(minSessions), session_waits(0), session_timeouts(0), session_creations(0), acquires(0), acquire_micros(0),
+	quiet_since(boost::chrono::steady_clock::now()), quiet_waits(0)
+{
+}
+
+
+Poco::Data::Session DBPool::acquire(const bool &wait)
+// Polls for a returned session, Poco SessionPool has no hook for when a session is put back
+{
+	const boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+	const boost::chrono::steady_clock::time_point deadline = start + boost::chrono::milliseconds(max_wait);
+	bool waited = false;
+	bool grown = false;
+	int backoff = 50;  // Microseconds, doubles upto 5ms
+
+	while (true)
+	{
+		bool reserved = false;
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_acquire);
+			if ((idle() > pending_gets) || ((used() + pending_gets) < soft_cap) || ((!wait) && ((used() + pending_gets) < max_sessions)))
+			{
+				++pending_gets;
+				reserved = true;
+			}
+			else if (!waited)
+			{
+				waited = true;
+				++session_waits;
+				++quiet_waits;
+			}
+		}
+		if (reserved)
+		{
+			// Outside lock, other callers don't wait on a new connection being opened
+			try
+			{
+				Poco::Data::Session session = get();
+				boost::lock_guard<boost::mutex> lock(mutex_acquire);
+				--pending_gets;
+				recordAcquire(start, waited);
+				return session;
+			}
+			catch (...)
+			{
+				boost::lock_guard<boost::mutex> lock(mutex_acquire);
+				--pending_gets;
+				throw;
+			}
+		}
+
+		const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+		if ((!wait) || (now >= deadline))
+		{
+			++session_timeouts;
+			throw Poco::Data::SessionPoolExhaustedException("Timed out waiting for a Database Session");
+		}
+		if ((!grown) && ((now - start) >= boost::chrono::milliseconds(2)))
+		// Waiting longer than a query usually takes, pool is to small for current load
+		{
+			grown = true;
+			growSoftCap();
+		}
+		boost::this_thread::sleep_for(boost::chrono::microseconds(backoff));
+		backoff = std::min(backoff * 2, 5000);
+	}
+}
+
+
+void DBPool::growSoftCap()
+{
+	int current_cap = soft_cap;
+	while (current_cap < max_sessions)
+	{
+		if (soft_cap.compare_exchange_weak(current_cap, current_cap + 1))
+		{
+			break;
+		}
+	}
+}
+
+
+void DBPool::recordAcquire(const boost::chrono::steady_clock::time_point &start, const bool &waited)
+// Called with mutex_acquire locked
+{
+	const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+	++acquires;
+	acquire_micros += boost::chrono::duration_cast<boost::chrono::microseconds>(now - start).count();
+
+	if ((now - quiet_since) >= boost::chrono::seconds(10))
+	{
+		if ((quiet_waits == 0) && (soft_cap > min_sessions) && (idle() > 0))
+		{
+			--soft_cap;
+		}
+		quiet_since = now;
+		quiet_waits = 0;
+	}
+}
+
+
+int DBPool::softCap() const
+{
+	return soft_cap;
+}
+
+
+int DBPool::waits() const
+{
+	return session_waits;
+}
+
+
+int DBPool::timeouts() const
+{
+	return session_timeouts;
+}
+
+
+int DBPool::creations() const
+{
+	return session_creations;
+}
+
+
+int DBPool::avgAcquireMicros() const
+{
+	const unsigned long long total_acquires = acquires;
+	if (total_acquires == 0)
+	{
+		return 0;
+	}
+	return static_cast<int>(acquire_micros / total_acquires);
+}
 
 
 void DBPool::customizeSession (Poco::Data::Session& session)
+// Called by Poco SessionPool for each new Database Session
 {
+	++session_creations;
 	try
 	{
 		session.setProperty("maxRetryAttempts", 100);
@@ -87,10 +235,29 @@ void DBPool::customizeSession (Poco::Data::Session& session)
 }
 
 
-Ext::Ext(void) {
+Ext::Ext(void) : current_job(&Ext::releaseJobContext), current_call(&Ext::releaseCallContext) {
 	mgr.reset (new IdManager);
 	extDB_lock = false;
 
+	sync_data_str.reserve(2000);
+	sync_result_str.reserve(2000);
+
+	pending_results = 0;
+	shed_queue_full = 0;
+	shed_pending_results = 0;
+	coalesced_calls = 0;
+	timed_out_jobs = 0;
+	thread_sessions = 0;
+	write_behind_running = false;
+	write_behind_batches = 0;
+	write_behind_failed = 0;
+	group_commits = 0;
+	group_commit_calls = 0;
+	group_commit_failed = 0;
+	deadlines_running = false;
+	draining = false;
+	shutdown_timeout = 10;
+
 	Poco::DateTime now;
 	Poco::Path log_path;
 	log_path.pushDirectory("extDB");
@@ -174,20 +341,34 @@ Ext::Ext(void) {
 		steam_api_key = pConf->getString("Main.Steam_WEB_API_KEY", "");
 
 		// Start Threads + ASIO
-		max_threads = pConf->getInt("Main.Threads", 0);
-        if (max_threads <= 0)
-        {
-            max_threads = boost::thread::hardware_concurrency();
-        }
-		io_work_ptr.reset(new boost::asio::io_service::work(io_service));
-        for (int i = 0; i < max_threads; ++i)
-        {
-            threads.create_thread(boost::bind(&boost::asio::io_service::run, &io_service));
-			#ifdef TESTING
-				std::cout << "extDB: Creating Worker Thread +1" << std::endl ;
-			#endif
-			pLogger->information("Creating Worker Thread +1");
-        }
+		//   Default Lane + any extra Lanes from [Lanes] section i.e Bulk = 2
+		int default_threads = pConf->getInt("Main.Threads", 0);
+		if (default_threads <= 0)
+		{
+			default_threads = boost::thread::hardware_concurrency();
+		}
+		max_threads = 0;
+		createWorkerLane("default", default_threads);
+
+		max_queued_jobs = pConf->getInt("Main.Max Queued Jobs", 0);
+		max_pending_results = pConf->getInt("Main.Max Pending Results", 0);
+
+		shutdown_timeout = pConf->getInt("Main.Shutdown Timeout", 10);
+
+		// Job Deadlines, Protocols use Main.Timeout unless they have own Timeout option
+		default_timeout = pConf->getInt("Main.Timeout", 0);
+		deadlines_running = true;
+		deadline_thread = boost::thread(boost::bind(&Ext::runDeadlines, this));
+
+		// Eviction of Stored Results never fetched, Unique ID is freed on eviction
+		result_store.startEviction(pConf->getInt("Main.Result TTL", 0), pConf->getInt("Main.Max Result Bytes", 0), boost::bind(&Ext::freeUniqueID_mutexlock, this, _1));
+
+		std::vector<std::string> lane_names;
+		pConf->keys("Lanes", lane_names);
+		for (std::vector<std::string>::iterator it = lane_names.begin(); it != lane_names.end(); ++it)
+		{
+			createWorkerLane(*it, pConf->getInt("Lanes." + *it, 1));
+		}
 
 		// Load Logging Filter Options
 		#ifdef TESTING
@@ -282,135 +463,232 @@ Ext::~Ext(void)
 }
 
 void Ext::stop()
+// Drains Worker Lanes, new ASYNC calls get [4] while queued + running jobs get Main.Shutdown Timeout to finish
+//   Jobs still queued after that are abandoned + logged
 {
+	if (draining.exchange(true))
+	{
+		return;  // Already stopped
+	}
 	#ifdef TESTING
 		std::cout << "extDB: Stopping Please Wait..." << std::endl;
 	#endif
 	pLogger->information("Stopping Please Wait...");
 
-	io_service.stop();
-    threads.join_all();
-    unordered_map_protocol.clear();
+	// Write Behind batches not due yet are queued now, so drain runs them
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_write_behind);
+		write_behind_running = false;
+		cond_write_behind.notify_all();
+	}
+	if (write_behind_thread.joinable())
+	{
+		write_behind_thread.join();
+	}
+	for (std::vector< boost::shared_ptr<WriteBehindQueue> >::iterator it = write_behind_queues.begin(); it != write_behind_queues.end(); ++it)
+	{
+		WriteBehindQueue::Batch batch;
+		if ((*it)->take(batch))
+		{
+			flushWriteBehind((*it)->protocolName(), batch);
+		}
+	}
+	for (std::vector< boost::shared_ptr<GroupCommitQueue> >::iterator it = group_commit_queues.begin(); it != group_commit_queues.end(); ++it)
+	{
+		if ((*it)->takeScheduled())
+		{
+			flushGroupCommit(*it);
+		}
+	}
+
+	const boost::chrono::steady_clock::time_point drain_deadline = boost::chrono::steady_clock::now() + boost::chrono::seconds(shutdown_timeout);
+	std::size_t completed_before = 0;
+	std::size_t completed_jobs = 0;
+	std::size_t abandoned_jobs = 0;
+	for (std::vector< boost::shared_ptr<WorkerLane> >::iterator it = worker_lanes.begin(); it != worker_lanes.end(); ++it)
+	{
+		completed_before += (*it)->executor.completed();
+	}
+	for (std::vector< boost::shared_ptr<WorkerLane> >::iterator it = worker_lanes.begin(); it != worker_lanes.end(); ++it)
+	{
+		if (!(*it)->executor.drain(drain_deadline))
+		{
+			pLogger->warning("Worker Lane " + (*it)->name + " didn't finish before Shutdown Timeout");
+		}
+	}
+	for (std::vector< boost::shared_ptr<WorkerLane> >::iterator it = worker_lanes.begin(); it != worker_lanes.end(); ++it)
+	{
+		abandoned_jobs += (*it)->executor.stop();
+		completed_jobs += (*it)->executor.completed();
+	}
+	completed_jobs -= completed_before;
+	#ifdef TESTING
+		std::cout << "extDB: Shutdown Completed Jobs: " << completed_jobs << " Abandoned Jobs: " << abandoned_jobs << std::endl;
+	#endif
+	pLogger->information("Shutdown Completed Jobs: " + Poco::NumberFormatter::format(completed_jobs) + " Abandoned Jobs: " + Poco::NumberFormatter::format(abandoned_jobs));
+	if (abandoned_jobs > 0)
+	{
+		pLogger->warning("Abandoned " + Poco::NumberFormatter::format(abandoned_jobs) + " queued jobs, increase Main.Shutdown Timeout");
+	}
+	for (std::vector< boost::shared_ptr<GroupCommitQueue> >::iterator it = group_commit_queues.begin(); it != group_commit_queues.end(); ++it)
+	{
+		// Commit job was abandoned, its calls were never run
+		GroupCommitQueue::Batch batch;
+		(*it)->abandon(batch);
+		resolveGroupCommit(*batch, "[0,\"Error Shutdown\"]");
+	}
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_deadlines);
+		deadlines_running = false;
+		cond_deadlines.notify_all();
+	}
+	if (deadline_thread.joinable())
+	{
+		deadline_thread.join();
+	}
+	result_store.stopEviction();
+	protocol_registry.clear();
 
-    if (boost::iequals(db_conn_info.db_type, std::string("MySQL")) == 1)
-        Poco::Data::MySQL::Connector::unregisterConnector();
-    else if (boost::iequals(db_conn_info.db_type, std::string ("ODBC")) == 1)
-        Poco::Data::ODBC::Connector::unregisterConnector();
-    else if (boost::iequals(db_conn_info.db_type, "SQLite") == 1)
-        Poco::Data::SQLite::Connector::unregisterConnector();
+	for (std::map< std::string, boost::shared_ptr<Database> >::iterator it = databases.begin(); it != databases.end(); ++it)
+	{
+		closeDatabase(*(it->second));
+	}
 
 	pLogger->information("Stopped");
+	pAsync->close();  // Flush Logger
+}
+
+void Ext::createWorkerLane(const std::string &lane_name, int lane_threads)
+{
+	const std::string name = boost::algorithm::to_lower_copy(lane_name);
+	std::size_t lane;
+	if (findWorkerLane(name, lane))
+	{
+		pLogger->warning("Worker Lane " + name + " already exists");
+		return;
+	}
+	if (lane_threads <= 0)
+	{
+		lane_threads = 1;
+	}
+
+	boost::shared_ptr<WorkerLane> worker_lane(new WorkerLane());
+	worker_lane->name = name;
+	worker_lane->executor.start(lane_threads);
+	#ifdef TESTING
+		std::cout << "extDB: Creating Worker Threads +" << lane_threads << " (" << name << ")" << std::endl ;
+	#endif
+	pLogger->information("Creating Worker Threads +" + Poco::NumberFormatter::format(lane_threads) + " (" + name + ")");
+	max_threads += lane_threads;
+	worker_lanes.push_back(worker_lane);
+}
+
+
+bool Ext::findWorkerLane(const std::string &lane_name, std::size_t &lane)
+// Worker Lanes are only created in constructor, so no lock needed
+{
+	const std::string name = boost::algorithm::to_lower_copy(lane_name);
+	for (std::size_t i = 0; i < worker_lanes.size(); ++i)
+	{
+		if (worker_lanes[i]->name == name)
+		{
+			lane = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void Ext::closeDatabase(Database &database)
+// Shuts down pools + unregisters Connector, each 9:DATABASE registered its Connector once (Poco counts registrations)
+{
+	if (database.pool)
+	{
+		database.pool->shutdown();
+	}
+	if (database.replica_pool)
+	{
+		database.replica_pool->shutdown();
+	}
+
+	if (database.db_type == "MySQL")
+		Poco::Data::MySQL::Connector::unregisterConnector();
+	else if (database.db_type == "ODBC")
+		Poco::Data::ODBC::Connector::unregisterConnector();
+	else if (database.db_type == "SQLite")
+		Poco::Data::SQLite::Connector::unregisterConnector();
 }
 
-void Ext::connectDatabase(char *output, const int &output_size, const std::string &conf_option)
+
+void Ext::connectDatabase(char *output, const int &output_size, const std::string &conf_option, const std::string &database_name)
+// Only called from arma main thread, Database is only added to databases once its pool is connected
+//   On failure after Connector was registered, Database is closed again (nothing is left registered / half built)
 {
-	// TODO ADD Code to check for database already initialized !!!!!!!!!!!
+	if (databases.find(database_name) != databases.end())
+	{
+		pLogger->warning("Database Already Connected: " + database_name);
+		std::strcpy(output, "[0,\"Database Already Connected\"]");
+		return;
+	}
+	boost::shared_ptr<Database> database;
+	bool connector_registered = false;
     try
     {
         if (pConf->hasOption(conf_option + ".Type"))
         {
+            database.reset(new Database());
+            database->name = database_name;
+            database->replica_lag = 0;
+            database->last_write = 0;
+            database->replica_reads = 0;
+            database->primary_reads = 0;
+
             // Database
-            db_conn_info.db_type = pConf->getString(conf_option + ".Type");
+            database->db_type = pConf->getString(conf_option + ".Type");
             std::string db_name = pConf->getString(conf_option + ".Name");
 
-            db_conn_info.min_sessions = pConf->getInt(conf_option + ".minSessions", 1);
-            if (db_conn_info.min_sessions <= 0)
+            database->min_sessions = pConf->getInt(conf_option + ".minSessions", 1);
+            if (database->min_sessions <= 0)
+            {
+                database->min_sessions = 1;
+            }
+            database->max_sessions = pConf->getInt(conf_option + ".maxSessions", max_threads);
+            if (database->max_sessions <= 0)
             {
-                db_conn_info.min_sessions = 1;
+                database->max_sessions = max_threads;
             }
-            db_conn_info.min_sessions = pConf->getInt(conf_option + ".maxSessions", 1);
-            if (db_conn_info.max_sessions <= 0)
+            if (database->max_sessions < database->min_sessions)
             {
-                db_conn_info.max_sessions = max_threads;
+                database->max_sessions = database->min_sessions;
             }
 			
-            db_conn_info.idle_time = pConf->getInt(conf_option + ".idleTime");
+            database->idle_time = pConf->getInt(conf_option + ".idleTime");
+            database->max_wait = pConf->getInt(conf_option + ".maxWait", 5000);
+            database->thread_sessions = pConf->getBool(conf_option + ".Thread Sessions", false);
 
 			#ifdef TESTING
-				std::cout << "extDB: Database Type: " << db_conn_info.db_type << std::endl;
+				std::cout << "extDB: Database Type: " << database->db_type << std::endl;
 			#endif
-			pLogger->information("Database Type: " + db_conn_info.db_type);
+			pLogger->information("Database Type: " + database->db_type);
 
-            if ( (boost::iequals(db_conn_info.db_type, std::string("MySQL")) == 1) || (boost::iequals(db_conn_info.db_type, std::string("ODBC")) == 1) )
+            if (boost::iequals(database->db_type, std::string("MySQL")) == 1)
             {
-                std::string username = pConf->getString(conf_option + ".Username");
-                std::string password = pConf->getString(conf_option + ".Password");
-
-                std::string ip = pConf->getString(conf_option + ".IP");
-                std::string port = pConf->getString(conf_option + ".Port");
-				
-				db_conn_info.connection_str = "host=" + ip + ";port=" + port + ";user=" + username + ";password=" + password + ";db=" + db_name + ";auto-reconnect=true";
-				
-                if (boost::iequals(db_conn_info.db_type, std::string("MySQL")) == 1)
-                {
-					db_conn_info.db_type = "MySQL";
-                    Poco::Data::MySQL::Connector::registerConnector();
-					std::string compress = pConf->getString(conf_option + ".Compress", "false");
-					if (boost::iequals(compress, "true") == 1)
-					{
-						db_conn_info.connection_str = db_conn_info.connection_str + "compress=true";
-					}
-                }
-				else
-                {
-					db_conn_info.db_type = "ODBC";
-                    Poco::Data::ODBC::Connector::registerConnector();
-				}
-
-                db_pool.reset(new DBPool(db_conn_info.db_type, 
-															db_conn_info.connection_str, 
-															db_conn_info.min_sessions, 
-															db_conn_info.max_sessions, 
-															db_conn_info.idle_time));
-                if (db_pool->get().isConnected())
-                {
-					#ifdef TESTING
-						std::cout << "extDB: Database Session Pool Started" << std::endl;
-					#endif
-					pLogger->information("Database Session Pool Started");
-                    std::strcpy(output, "[1]");
-                }
-                else
-                {
-					#ifdef TESTING
-						std::cout << "extDB: Database Session Pool Failed" << std::endl;
-					#endif
-					pLogger->critical("Database Session Pool Failed");
-					std::strcpy(output, "[0,\"Database Session Pool Failed\"]");
-                }
+                database->db_type = "MySQL";
+                Poco::Data::MySQL::Connector::registerConnector();
+                connector_registered = true;
             }
-            else if (boost::iequals(db_conn_info.db_type, "SQLite") == 1)
+            else if (boost::iequals(database->db_type, std::string("ODBC")) == 1)
             {
-				db_conn_info.db_type = "SQLite";
+                database->db_type = "ODBC";
+                Poco::Data::ODBC::Connector::registerConnector();
+                connector_registered = true;
+            }
+            else if (boost::iequals(database->db_type, "SQLite") == 1)
+            {
+                database->db_type = "SQLite";
                 Poco::Data::SQLite::Connector::registerConnector();
-				Poco::Path db_path;
-				db_path.pushDirectory("extDB");
-				db_path.pushDirectory("sqlite");
-				db_path.setFileName(db_name);
-                db_conn_info.connection_str = db_path.toString();
-
-                db_pool.reset(new DBPool(db_conn_info.db_type, 
-															db_conn_info.connection_str, 
-															db_conn_info.min_sessions, 
-															db_conn_info.max_sessions, 
-															db_conn_info.idle_time));
-
-                if (db_pool->get().isConnected())
-                {
-					#ifdef TESTING
-						std::cout << "extDB: Database Session Pool Started" << std::endl;
-					#endif
-					pLogger->information("Database Session Pool Started");
-                    std::strcpy(output, "[1]");
-                }
-                else
-                {
-					#ifdef TESTING
-						std::cout << "extDB: Database Session Pool Failed" << std::endl;
-					#endif
-					pLogger->critical("Database Session Pool Failed");
-                    std::strcpy(output, "[0,\"Database Session Pool Failed\"]");
-                }
+                connector_registered = true;
             }
             else
             {
@@ -419,6 +697,42 @@ void Ext::connectDatabase(char *output, const int &output_size, const std::strin
 				#endif 
 				pLogger->error("No Database Engine Found for " + db_name + ".");
 				std::strcpy(output, "[0,\"Unknown Database Type\"]");
+				return;
+            }
+
+            database->connection_str = getConnectionString(conf_option, database->db_type);
+            database->pool.reset(new DBPool(database->db_type, 
+														database->connection_str, 
+														database->min_sessions, 
+														database->max_sessions, 
+														database->idle_time,
+														database->max_wait));
+            if (!database->pool->get().isConnected())
+            {
+				#ifdef TESTING
+					std::cout << "extDB: Database Session Pool Failed" << std::endl;
+				#endif
+				pLogger->critical("Database Session Pool Failed");
+				std::strcpy(output, "[0,\"Database Session Pool Failed\"]");
+				closeDatabase(*database);
+            }
+            else if (pConf->hasOption(conf_option + ".Replica") && (!connectReplica(pConf->getString(conf_option + ".Replica"), *database)))
+            {
+				std::strcpy(output, "[0,\"Database Replica Failed\"]");
+				closeDatabase(*database);
+            }
+            else
+            {
+				#ifdef TESTING
+					std::cout << "extDB: Database Session Pool Started" << std::endl;
+				#endif
+				pLogger->information("Database Session Pool Started: " + database_name);
+				databases[database_name] = database;
+				if (!default_database)
+				{
+					default_database = database;
+				}
+				std::strcpy(output, "[1]");
             }
         }
         else
@@ -436,11 +750,96 @@ void Ext::connectDatabase(char *output, const int &output_size, const std::strin
 			std::cout << "extDB: Database Setup Failed: " << e.displayText() << std::endl;
 		#endif
 		pLogger->error("Database Setup Failed: " + e.displayText());
-        std::exit(EXIT_FAILURE);
+		if (connector_registered)
+		{
+			databases.erase(database_name);
+			if (default_database == database)
+			{
+				default_database.reset();
+			}
+			closeDatabase(*database);
+		}
+		std::strcpy(output, "[0,\"Database Setup Failed\"]");
     }
 }
 
 
+bool Ext::connectReplica(const std::string &replica_option, Database &database)
+// Replica Section has same options as a Database Section, Type has to match
+//   Pool sizing defaults to primary Database values
+{
+	if (!pConf->hasOption(replica_option + ".Type"))
+	{
+		pLogger->error("No Config Option Found: " + replica_option + ".");
+		return false;
+	}
+	if (boost::iequals(pConf->getString(replica_option + ".Type"), database.db_type) != 1)
+	{
+		pLogger->error("Replica " + replica_option + " Type doesn't match Database " + database.name);
+		return false;
+	}
+
+	int min_sessions = pConf->getInt(replica_option + ".minSessions", database.min_sessions);
+	int max_sessions = pConf->getInt(replica_option + ".maxSessions", database.max_sessions);
+	if (min_sessions <= 0)
+	{
+		min_sessions = 1;
+	}
+	if (max_sessions < min_sessions)
+	{
+		max_sessions = min_sessions;
+	}
+	database.replica_lag = pConf->getInt(replica_option + ".Replica Lag", 1);
+	database.replica_connection_str = getConnectionString(replica_option, database.db_type);
+	database.replica_pool.reset(new DBPool(database.db_type, 
+													database.replica_connection_str, 
+													min_sessions, 
+													max_sessions, 
+													pConf->getInt(replica_option + ".idleTime", database.idle_time),
+													pConf->getInt(replica_option + ".maxWait", database.max_wait)));
+	if (!database.replica_pool->get().isConnected())
+	{
+		pLogger->critical("Database Replica Session Pool Failed: " + replica_option);
+		database.replica_pool->shutdown();
+		database.replica_pool.reset();
+		return false;
+	}
+	pLogger->information("Database Replica Session Pool Started: " + database.name + " -> " + replica_option);
+	return true;
+}
+
+
+std::string Ext::getConnectionString(const std::string &conf_option, const std::string &db_type)
+{
+	std::string db_name = pConf->getString(conf_option + ".Name");
+	if (db_type == "SQLite")
+	{
+		Poco::Path db_path;
+		db_path.pushDirectory("extDB");
+		db_path.pushDirectory("sqlite");
+		db_path.setFileName(db_name);
+		return db_path.toString();
+	}
+
+	std::string username = pConf->getString(conf_option + ".Username");
+	std::string password = pConf->getString(conf_option + ".Password");
+
+	std::string ip = pConf->getString(conf_option + ".IP");
+	std::string port = pConf->getString(conf_option + ".Port");
+
+	std::string connection_str = "host=" + ip + ";port=" + port + ";user=" + username + ";password=" + password + ";db=" + db_name + ";auto-reconnect=true";
+	if (db_type == "MySQL")
+	{
+		std::string compress = pConf->getString(conf_option + ".Compress", "false");
+		if (boost::iequals(compress, "true") == 1)
+		{
+			connection_str += ";compress=true";
+		}
+	}
+	return connection_str;
+}
+
+
 std::string Ext::version() const
 {
     return "16";
@@ -454,426 +853,1686 @@ std::string Ext::getAPIKey()
 
 
 int Ext::getUniqueID_mutexlock()
+// Lock free, returns -1 if all Unique IDs are in use
 {
-    boost::lock_guard<boost::mutex> lock(mutex_unique_id);
-    return mgr.get()->AllocateId();
+	const int unique_id = mgr->AllocateId();
+	if (unique_id != -1)
+	{
+		++pending_results;
+	}
+	return unique_id;
 }
 
 
 void Ext::freeUniqueID_mutexlock(const int &unique_id)
 {
-    boost::lock_guard<boost::mutex> lock(mutex_unique_id);
-    mgr.get()->FreeId(unique_id);
+	--pending_results;
+	mgr->FreeId(unique_id);
 }
 
-Poco::Data::Session Ext::getDBSession_mutexlock()
-// Gets available DB Session (mutex lock)
+
+bool Ext::admitJob(const ProtocolEntry &protocol_entry, const bool &save_result)
+// Checks Admission Limits before Job is queued, so a stalled database can't grow queues until arma runs out of memory
 {
-	try
+	if (draining)
+	{
+		return false;
+	}
+	std::size_t queued_jobs = worker_lanes[protocol_entry.lane]->executor.pending();
+	if (protocol_entry.limiter)
+	{
+		queued_jobs += protocol_entry.limiter->waiting();
+	}
+	if ((max_queued_jobs > 0) && (queued_jobs >= static_cast<std::size_t>(max_queued_jobs)))
 	{
-		boost::lock_guard<boost::mutex> lock(mutex_db_pool);
-		Poco::Data::Session free_session =  db_pool->get();
-		return free_session;
+		++shed_queue_full;
+		return false;
 	}
-	catch (Poco::Data::SessionPoolExhaustedException&)
-	//	Exceptiontal Handling in event of scenario if all asio worker threads are busy using all db connections
-	//		And there is SYNC call using db & db_pool = exhausted
+	if (save_result && (max_pending_results > 0) && (pending_results >= max_pending_results))
 	{
-		Poco::Data::Session new_session(db_conn_info.db_type, db_conn_info.connection_str);
-		return new_session;
+		++shed_pending_results;
+		return false;
 	}
+	return true;
 }
 
-std::string Ext::getDBType()
+
+void Ext::postJob(const ProtocolEntry &protocol_entry, const Executor::Job &job)
+// Queues Job on Protocol Worker Lane
+//   If Protocol has maxConcurrency + all slots are busy, Job waits in the limiter until a running Job finishes
+{
+	if (!protocol_entry.limiter)
+	{
+		worker_lanes[protocol_entry.lane]->executor.post(job);
+	}
+	else if (protocol_entry.limiter->acquire(job))
+	{
+		worker_lanes[protocol_entry.lane]->executor.post(boost::bind(&Ext::runLimitedJob, this, protocol_entry.limiter, protocol_entry.lane, job));
+	}
+}
+
+
+void Ext::runLimitedJob(const boost::shared_ptr<ConcurrencyLimiter> limiter, const std::size_t lane, const Executor::Job job)
 {
-	return db_conn_info.db_type;
+	LimiterSlot slot(this, limiter, lane);
+	job();
 }
 
-void Ext::getResult_mutexlock(const int &unique_id, char *output, const int &output_size)
-// Gets Result String from unordered map array
-//   If length of String = 0, sends arma "", and removes entry from unordered map array
-//   If <=, then sends output to arma
-//   If >, then sends 1 part to arma + stores rest.
+
+Ext::LimiterSlot::~LimiterSlot()
 {
-	boost::lock_guard<boost::mutex> lock(mutex_unordered_map_results); // TODO Try to make Mutex Lock smaller
-	boost::unordered_map<int, std::string>::const_iterator it = unordered_map_results.find(unique_id);
-	if (it == unordered_map_results.end()) // NO UNIQUE ID or WAIT
+	Executor::Job next_job;
+	if (limiter->release(next_job))
 	{
-		if (unordered_map_wait.count(unique_id) == 0)
-		{
-			std::strcpy(output, (""));
-		}
-		else
-		{
-			std::strcpy(output, ("[3]"));
-		}
+		ext->worker_lanes[lane]->executor.post(boost::bind(&Ext::runLimitedJob, ext, limiter, lane, next_job));
 	}
-	else if (it->second.empty()) // END of MSG
+}
+
+
+void Ext::releaseJobContext(JobContext *job_context)
+// current_job doesn't own JobContext, job wrapper holds it
+{
+}
+
+
+Executor::Job Ext::withDeadline(const Executor::Job &job, const int &timeout, const int &unique_id)
+// Wraps job with a deadline (seconds from now), timeout 0 = job is returned as is
+{
+	if (timeout <= 0)
 	{
-		unordered_map_results.erase(unique_id);
-		freeUniqueID_mutexlock(unique_id);
-		std::strcpy(output, (""));
+		return job;
 	}
-	else // SEND MSG (Part)
+	boost::shared_ptr<JobContext> job_context(new JobContext());
+	job_context->unique_id = unique_id;
+	job_context->timed_out = false;
+	job_context->finished = false;
+	job_context->database = NULL;
+	job_context->replica = false;
+	job_context->mysql_thread_id = 0;
 	{
-		std::string msg = it->second.substr(0, output_size-9);
-		std::strcpy(output, msg.c_str());
-		if (it->second.length() > (output_size-9))
-		{
-			unordered_map_results[unique_id] = it->second.substr(output_size-9);
-		}
-		else
+		boost::lock_guard<boost::mutex> lock(mutex_deadlines);
+		job_context->deadline = deadlines.insert(std::make_pair(boost::chrono::steady_clock::now() + boost::chrono::seconds(timeout), job_context));
+		job_context->deadline_queued = true;
+		cond_deadlines.notify_one();
+	}
+	return boost::bind(&Ext::runDeadlineJob, this, job_context, job);
+}
+
+
+void Ext::runDeadlineJob(const boost::shared_ptr<JobContext> job_context, const Executor::Job job)
+{
+	{
+		boost::lock_guard<boost::mutex> lock(job_context->mutex);
+		if (job_context->timed_out && (job_context->unique_id != -1))
+		// Ticket already resolved while job was still queued
 		{
-			unordered_map_results[unique_id].clear();
+			job_context->finished = true;
+			return;
 		}
 	}
+	DeadlineScope deadline_scope(this, job_context);
+	job();
 }
 
 
-void Ext::saveResult_mutexlock(const std::string &result, const int &unique_id)
-// Stores Result String  in a unordered map array.
-//   Used when string > arma output char
+Ext::DeadlineScope::DeadlineScope(Ext *ext, const boost::shared_ptr<JobContext> &job_context) : ext(ext), job_context(job_context)
 {
-	boost::lock_guard<boost::mutex> lock(mutex_unordered_map_results);
-	unordered_map_results[unique_id] = "[1," + result + "]";
-	unordered_map_wait.erase(unique_id);
+	ext->current_job.reset(job_context.get());
 }
 
 
-void Ext::addProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &protocol_name, const std::string &init_data)
+Ext::DeadlineScope::~DeadlineScope()
 {
+	ext->current_job.reset();
 	{
-		// TODO Implement Poco ClassLoader -- dayz hive ext has it to load database dll
-		boost::lock_guard<boost::mutex> lock(mutex_unordered_map_protocol);
-		if (boost::iequals(protocol, std::string("MISC")) == 1)
-		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new MISC());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
+		// Session goes back to pool here
+		boost::lock_guard<boost::mutex> lock(job_context->mutex);
+		job_context->finished = true;
+		job_context->session.reset();
+	}
+	ext->finishDeadline(*job_context);
+}
+
+
+void Ext::finishDeadline(JobContext &job_context)
+// Drops deadline of a finished job, so deadlines only holds jobs still queued / running
+{
+	boost::lock_guard<boost::mutex> lock(mutex_deadlines);
+	if (job_context.deadline_queued)
+	{
+		job_context.deadline_queued = false;
+		deadlines.erase(job_context.deadline);
+	}
+}
+
+
+void Ext::trackSession(JobContext &job_context, Database &database, const bool &replica, Poco::Data::Session &session)
+// MySQL Connection ID comes from client lib handle, no extra query per session
+{
+	unsigned long thread_id = 0;
+	if (database.db_type == "MySQL")
+	{
+		MYSQL *mysql = NativeMySQL::handle(session);
+		if (mysql != NULL)
+		{
+			thread_id = mysql_thread_id(mysql);
+		}
+	}
+	boost::lock_guard<boost::mutex> lock(job_context.mutex);
+	job_context.session.reset(new Poco::Data::Session(session));
+	job_context.database = &database;
+	job_context.replica = replica;
+	job_context.mysql_thread_id = thread_id;
+}
+
+
+void Ext::cancelQuery(JobContext &job_context)
+// Called with job_context.mutex unlocked, side connection for KILL QUERY is opened without holding it
+//   KILL QUERY + sqlite3_interrupt run under job_context.mutex, so session can't be back in pool meanwhile
+{
+	Database *database;
+	bool replica;
+	unsigned long mysql_thread_id;
+	{
+		boost::lock_guard<boost::mutex> lock(job_context.mutex);
+		if ((!job_context.session) || job_context.finished)
+		{
+			return;
+		}
+		database = job_context.database;
+		replica = job_context.replica;
+		mysql_thread_id = job_context.mysql_thread_id;
+	}
+	try
+	{
+		if ((database->db_type == "MySQL") && (mysql_thread_id != 0))
+		{
+			// Side connection, pooled sessions could all be busy
+			Poco::Data::Session kill_session(database->db_type, (replica ? database->replica_connection_str : database->connection_str));
+			boost::lock_guard<boost::mutex> lock(job_context.mutex);
+			if (job_context.session && (!job_context.finished))
+			{
+				kill_session << ("KILL QUERY " + Poco::NumberFormatter::format(mysql_thread_id)), Poco::Data::now;
 			}
 		}
-		else if (boost::iequals(protocol, std::string("DB_BASIC")) == 1)
+		else if (database->db_type == "SQLite")
+		{
+			boost::lock_guard<boost::mutex> lock(job_context.mutex);
+			if (job_context.session && (!job_context.finished))
+			{
+				sqlite3_interrupt(Poco::Data::SQLite::Utility::dbHandle(*(job_context.session)));
+			}
+		}
+		// ODBC has no cancel, only ticket is resolved
+	}
+	catch (Poco::Exception& e)
+	{
+		pLogger->error("Failed to cancel query: " + e.displayText());
+	}
+}
+
+
+void Ext::runDeadlines()
+// Watchdog Thread, sleeps until next deadline
+{
+	const ResultStore::Buffer timeout_result(new std::string("[0,\"Error Timeout\"]"));
+	boost::unique_lock<boost::mutex> lock(mutex_deadlines);
+	while (deadlines_running)
+	{
+		if (deadlines.empty())
+		{
+			cond_deadlines.wait(lock);
+			continue;
+		}
+		const boost::chrono::steady_clock::time_point next_deadline = deadlines.begin()->first;
+		if (boost::chrono::steady_clock::now() < next_deadline)
+		{
+			cond_deadlines.wait_until(lock, next_deadline);
+			continue;
+		}
+		boost::shared_ptr<JobContext> job_context = deadlines.begin()->second;
+		job_context->deadline_queued = false;
+		deadlines.erase(deadlines.begin());
+		lock.unlock();
+
+		bool timed_out = false;
+		{
+			boost::lock_guard<boost::mutex> job_lock(job_context->mutex);
+			if (!job_context->finished)
+			{
+				timed_out = true;
+				job_context->timed_out = true;
+				++timed_out_jobs;
+				if (job_context->unique_id != -1)
+				{
+					result_store.save(job_context->unique_id, timeout_result);
+				}
+			}
+		}
+		if (timed_out)
+		{
+			cancelQuery(*job_context);
+			pLogger->warning("Job Timeout, Unique ID: " + Poco::NumberFormatter::format(job_context->unique_id));
+		}
+
+		lock.lock();
+	}
+}
+
+
+void Ext::getStats(char *output, const int &output_size)
+// 9:STATS -- [1,[[NAME,VALUE],...]]
+//   If stats don't fit into arma output, same as a SYNC call: stats are stored + [2,"ID"] is returned (fetch with 5:ID)
+{
+	if (writeStats(output, output_size))
+	{
+		return;
+	}
+
+	std::vector<char> stats(4096);
+	while (!writeStats(&stats[0], (stats.size() - 1)))
+	{
+		stats.resize(stats.size() * 2);
+	}
+
+	OutputWriter writer(output, output_size);
+	const int unique_id = getUniqueID_mutexlock();
+	if (unique_id == -1)
+	{
+		writer.append("[0,\"Error Unique IDs Exhausted\"]");
+	}
+	else
+	{
+		result_store.save(unique_id, ResultStore::Buffer(new std::string(&stats[0])));
+		writer.append("[2,\"").append(unique_id).append("\"]");
+	}
+}
+
+
+bool Ext::writeStats(char *output, const int &output_size)
+// Returns false if stats were truncated
+{
+	int queued_jobs = 0;
+	for (std::vector< boost::shared_ptr<WorkerLane> >::iterator it = worker_lanes.begin(); it != worker_lanes.end(); ++it)
+	{
+		queued_jobs += (*it)->executor.pending();
+	}
+
+	OutputWriter writer(output, output_size);
+	writer.append("[1,[");
+	writer.append("[\"Queued Jobs\",").append(queued_jobs).append("]");
+	writer.append(",[\"Pending Results\",").append(pending_results).append("]");
+	writer.append(",[\"Shed Queue Full\",").append(shed_queue_full).append("]");
+	writer.append(",[\"Shed Pending Results\",").append(shed_pending_results).append("]");
+	writer.append(",[\"Coalesced Calls\",").append(coalesced_calls).append("]");
+	writer.append(",[\"Resident Result Bytes\",").append(static_cast<int>(result_store.residentBytes())).append("]");
+	writer.append(",[\"Evicted Results\",").append(static_cast<int>(result_store.evictions())).append("]");
+	writer.append(",[\"Timed Out Jobs\",").append(timed_out_jobs).append("]");
+	writer.append(",[\"Thread Sessions Opened\",").append(thread_sessions).append("]");
+	writer.append(",[\"Write Behind Batches\",").append(write_behind_batches).append("]");
+	writer.append(",[\"Write Behind Failed Batches\",").append(write_behind_failed).append("]");
+	writer.append(",[\"Group Commits\",").append(group_commits).append("]");
+	writer.append(",[\"Group Commit Calls\",").append(group_commit_calls).append("]");
+	writer.append(",[\"Group Commit Failed\",").append(group_commit_failed).append("]");
+	for (std::map< std::string, boost::shared_ptr<Database> >::iterator it = databases.begin(); it != databases.end(); ++it)
+	{
+		DBPool &pool = *(it->second->pool);
+		const std::string prefix = ",[\"Database " + it->first + ": ";
+		writer.append(prefix).append("Sessions Active\",").append(pool.used()).append("]");
+		writer.append(prefix).append("Sessions Idle\",").append(pool.idle()).append("]");
+		writer.append(prefix).append("Sessions Soft Cap\",").append(pool.softCap()).append("]");
+		writer.append(prefix).append("Session Waits\",").append(pool.waits()).append("]");
+		writer.append(prefix).append("Session Wait Timeouts\",").append(pool.timeouts()).append("]");
+		writer.append(prefix).append("Session Creations\",").append(pool.creations()).append("]");
+		writer.append(prefix).append("Session Avg Acquire us\",").append(pool.avgAcquireMicros()).append("]");
+		if (it->second->replica_pool)
+		{
+			DBPool &replica_pool = *(it->second->replica_pool);
+			writer.append(prefix).append("Replica Reads\",").append(it->second->replica_reads).append("]");
+			writer.append(prefix).append("Primary Reads\",").append(it->second->primary_reads).append("]");
+			writer.append(prefix).append("Replica Sessions Active\",").append(replica_pool.used()).append("]");
+			writer.append(prefix).append("Replica Sessions Idle\",").append(replica_pool.idle()).append("]");
+			writer.append(prefix).append("Replica Session Waits\",").append(replica_pool.waits()).append("]");
+			writer.append(prefix).append("Replica Session Avg Acquire us\",").append(replica_pool.avgAcquireMicros()).append("]");
+		}
+	}
+	writer.append("]]");
+	return !writer.truncated();
+}
+
+Poco::Data::Session Ext::getDBSession_mutexlock()
+// Gets available DB Session of current Protocols Database (mutex lock, none for Thread Sessions on a Worker Thread)
+{
+	return getSession(false);
+}
+
+
+Poco::Data::Session Ext::getDBReadSession_mutexlock()
+// Same as getDBSession_mutexlock, but uses Read Replica of Database if it has one
+{
+	return getSession(true);
+}
+
+
+Poco::Data::Session Ext::getSession(const bool &read_only)
+// Write calls always use primary Database, Database remembers when it was last written to for ReadYourWrites=true Protocols
+//   Called from a job with a deadline, session is tracked so watchdog can cancel its query
+{
+	CallContext *call_context = current_call.get();
+	Database &database = getDatabase();
+	if (call_context->session != NULL)
+	// Write Behind batch, reads + writes share batch transaction
+	{
+		return *(call_context->session);
+	}
+	const long long now = boost::chrono::steady_clock::now().time_since_epoch().count();
+
+	bool replica = false;
+	if (!read_only)
+	{
+		call_context->wrote = true;
+		database.last_write = now;
+	}
+	else if (database.replica_pool)
+	{
+		replica = true;
+		if (call_context->protocol_entry->read_your_writes)
+		{
+			const boost::chrono::steady_clock::duration since_write(now - database.last_write);
+			replica = (since_write >= boost::chrono::seconds(database.replica_lag));
+		}
+		if (replica)
+		{
+			++database.replica_reads;
+		}
+		else
+		{
+			++database.primary_reads;
+		}
+	}
+
+	Poco::Data::Session session = (database.thread_sessions && Executor::isWorkerThread()) ? getThreadSession(database, replica) : getPoolSession(database, replica);
+	JobContext *job_context = current_job.get();
+	if (job_context != NULL)
+	{
+		trackSession(*job_context, database, replica, session);
+	}
+	return session;
+}
+
+
+Poco::Data::Session& Ext::getThreadSession(Database &database, const bool &replica)
+// Worker Thread only, session is (re)opened on first use + if connection was lost
+{
+	boost::thread_specific_ptr<ThreadSession> &thread_session = replica ? database.replica_thread_session : database.thread_session;
+	ThreadSession *session = thread_session.get();
+	if ((session == NULL) || (!session->session.isConnected()))
+	{
+		// Old ThreadSession is deleted here, its Protocol caches go before its Session
+		session = new ThreadSession(database.db_type, (replica ? database.replica_connection_str : database.connection_str));
+		try
+		{
+			session->session.setProperty("maxRetryAttempts", 100);
+		}
+		catch (Poco::Data::NotSupportedException&)
+		{
+		}
+		thread_session.reset(session);
+		pLogger->information("Thread Session Opened (" + database.name + (replica ? " Replica" : "") + "), Total Opened: " + Poco::NumberFormatter::format(++thread_sessions));
+	}
+	return session->session;
+}
+
+
+Poco::Data::Session Ext::getPoolSession(Database &database, const bool &replica)
+// Worker Threads wait upto maxWait for a pooled session, SessionPoolExhaustedException after that
+//   Arma main thread never waits, a SYNC call must not freeze the server frame
+{
+	const bool wait = Executor::isWorkerThread();
+	if (replica)
+	{
+		return database.replica_pool->acquire(wait);
+	}
+	return database.pool->acquire(wait);
+}
+
+
+void Ext::releaseCallContext(CallContext *call_context)
+// current_call doesn't own CallContext, it lives in a CallScope on stack of caller
+{
+}
+
+
+Ext::CallScope::CallScope(Ext *ext, const ProtocolEntry *protocol_entry) : ext(ext), previous_call(ext->current_call.get())
+{
+	call_context.protocol_entry = protocol_entry;
+	call_context.wrote = false;
+	call_context.session = NULL;
+	ext->current_call.reset(&call_context);
+}
+
+
+Ext::CallScope::~CallScope()
+{
+	ext->current_call.reset(previous_call);
+	if (call_context.wrote && call_context.protocol_entry->database)
+	// Write is visible on primary now, ReadYourWrites reads wait Replica Lag from here
+	{
+		call_context.protocol_entry->database->last_write = boost::chrono::steady_clock::now().time_since_epoch().count();
+	}
+}
+
+
+Database& Ext::getDatabase()
+{
+	CallContext *call_context = current_call.get();
+	if ((call_context == NULL) || (!call_context->protocol_entry->database))
+	{
+		throw Poco::Data::DataException("No Database Connection");
+	}
+	return *(call_context->protocol_entry->database);
+}
+
+
+void Ext::callProtocol(const ProtocolEntry &protocol_entry, const std::string &data, std::string &result)
+// Protocol gets its Sessions from its own Database while call runs
+{
+	CallScope call_scope(this, &protocol_entry);
+	protocol_entry.protocol->callProtocol(this, data, result);
+}
+
+
+std::string Ext::getDBType()
+{
+	CallContext *call_context = current_call.get();
+	if ((call_context == NULL) || (!call_context->protocol_entry->database))
+	{
+		return "";
+	}
+	return call_context->protocol_entry->database->db_type;
+}
+
+
+bool Ext::useNativeEngine()
+{
+	CallContext *call_context = current_call.get();
+	return ((call_context != NULL) && call_context->protocol_entry->native);
+}
+
+
+bool Ext::useThreadSessions()
+{
+	CallContext *call_context = current_call.get();
+	return ((call_context != NULL) && call_context->protocol_entry->database && call_context->protocol_entry->database->thread_sessions);
+}
+
+
+boost::shared_ptr<SessionCache>* Ext::getSessionCache(Poco::Data::Session &session, const void *owner)
+// Thread Sessions are only closed by their Worker Thread (reconnect / exit), which deletes caches first
+{
+	CallContext *call_context = current_call.get();
+	if ((call_context == NULL) || (!call_context->protocol_entry->database))
+	{
+		return NULL;
+	}
+	Database &database = *(call_context->protocol_entry->database);
+	ThreadSession *thread_session = database.thread_session.get();
+	if ((thread_session != NULL) && (thread_session->session.impl() == session.impl()))
+	{
+		return &(thread_session->caches[owner]);
+	}
+	thread_session = database.replica_thread_session.get();
+	if ((thread_session != NULL) && (thread_session->session.impl() == session.impl()))
+	{
+		return &(thread_session->caches[owner]);
+	}
+	return NULL;
+}
+
+void Ext::getResult_mutexlock(const int &unique_id, char *output, const int &output_size)
+// Gets next part of Result from result_store
+//   Once all of Result is sent, sends arma "" + frees Unique ID
+{
+	if (result_store.read(unique_id, output, (output_size-9)) == ResultStore::FINISHED)
+	{
+		freeUniqueID_mutexlock(unique_id);
+	}
+}
+
+
+void Ext::getResults_mutexlock(const boost::string_ref &unique_ids, char *output, const int &output_size)
+// Status of multiple Unique IDs in one call i.e 6:ID:ID:ID
+//   [1,[["ID",STATUS],...]] STATUS 0 = Unknown ID, 2 = Ready (fetch with 5:ID), 3 = Waiting
+//   STATUS 1 = Complete, ["ID",1,RESULT] whole Result is included + Unique ID is freed (no 5:ID needed)
+//   Results are only included while they fit into output, IDs that don't fit at all are left out of reply
+{
+	// Check all IDs first, so invalid message doesn't free any results
+	std::size_t start = 0;
+	while (start <= unique_ids.length())
+	{
+		std::size_t end = OutputParser::find(unique_ids, ':', start);
+		if (end == boost::string_ref::npos)
+		{
+			end = unique_ids.length();
+		}
+		int unique_id;
+		if (!OutputParser::parseInt(unique_ids.substr(start, (end-start)), unique_id))
+		{
+			std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
+			return;
+		}
+		start = end + 1;
+	}
+
+	const std::size_t reserved_size = 22;  // ["ID",STATUS, + closing brackets
+	OutputWriter writer(output, output_size);
+	writer.append("[1,[");
+	start = 0;
+	bool first_id = true;
+	while ((start <= unique_ids.length()) && ((writer.length() + reserved_size) <= static_cast<std::size_t>(output_size)))
+	{
+		std::size_t end = OutputParser::find(unique_ids, ':', start);
+		if (end == boost::string_ref::npos)
+		{
+			end = unique_ids.length();
+		}
+		int unique_id;
+		OutputParser::parseInt(unique_ids.substr(start, (end-start)), unique_id);
+		start = end + 1;
+
+		ResultStore::Buffer buffer;
+		const ResultStore::ReadStatus status = result_store.readWhole(unique_id, buffer, (output_size - writer.length() - reserved_size));
+
+		if (!first_id)
+		{
+			writer.append(",");
+		}
+		first_id = false;
+		writer.append("[\"").append(unique_id).append("\"");
+		switch (status)
+		{
+			case ResultStore::FINISHED:
+				writer.append(",1,").append(*buffer).append("]");
+				freeUniqueID_mutexlock(unique_id);
+				break;
+			case ResultStore::READY:
+				writer.append(",2]");
+				break;
+			case ResultStore::WAITING:
+				writer.append(",3]");
+				break;
+			default:
+				writer.append(",0]");
+		}
+	}
+	writer.append("]]");
+}
+
+
+void Ext::getCompletions(const boost::string_ref &cursor_str, char *output, const int &output_size)
+// Unique IDs with results saved since cursor i.e 7:CURSOR, 7: returns current cursor only
+//   [1,"NEXT_CURSOR",["ID","ID",...],COMPLETE] COMPLETE = false if IDs were missed (cursor to old / from before a restart), poll outstanding IDs with 6:ID:ID
+//   CURSOR = EPOCH-COUNT, treat as opaque string
+{
+	const unsigned long long epoch = result_store.completionEpoch();
+	unsigned long long cursor;
+	std::vector<int> unique_ids;
+	bool complete = true;
+	if (cursor_str.empty())
+	{
+		cursor = result_store.completionCursor();
+	}
+	else
+	{
+		const std::size_t found = cursor_str.find('-');
+		unsigned long long cursor_epoch;
+		if ((found == boost::string_ref::npos) || (!OutputParser::parseUInt64(cursor_str.substr(0, found), cursor_epoch)) || (!OutputParser::parseUInt64(cursor_str.substr(found+1), cursor)))
+		{
+			std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
+			return;
+		}
+		// Max IDs that fit into output, ID is max 11 chars + quotes + ,
+		const int max_ids = (output_size - 60) / 14;
+		unique_ids.reserve(max_ids > 0 ? max_ids : 0);
+		complete = result_store.completions(cursor_epoch, cursor, unique_ids, (max_ids > 0 ? max_ids : 0));
+	}
+
+	OutputWriter writer(output, output_size);
+	writer.append("[1,\"").append(epoch).append("-").append(cursor).append("\",[");
+	for (std::vector<int>::iterator it = unique_ids.begin(); it != unique_ids.end(); ++it)
+	{
+		if (it != unique_ids.begin())
+		{
+			writer.append(",");
+		}
+		writer.append("\"").append(*it).append("\"");
+	}
+	writer.append("],").append(complete ? "true" : "false").append("]");
+}
+
+
+void Ext::saveResult_mutexlock(const std::string &result, const int &unique_id)
+// Stores Result String in result_store.
+//   Used when string > arma output char
+//   Result is dropped if job timed out, ticket was already resolved by watchdog
+{
+	JobContext *job_context = current_job.get();
+	if (job_context == NULL)
+	{
+		result_store.save(unique_id, ResultStore::Buffer(new std::string("[1," + result + "]")));
+	}
+	else
+	{
+		const ResultStore::Buffer result_buffer(new std::string("[1," + result + "]"));
+		boost::lock_guard<boost::mutex> lock(job_context->mutex);
+		if (!(job_context->timed_out && (job_context->unique_id != -1)))
+		{
+			job_context->finished = true;
+			result_store.save(unique_id, result_buffer);
+		}
+	}
+}
+
+
+void Ext::saveResult_mutexlock(const std::string &result, const std::vector<int> &unique_ids)
+// Stores one Result String for multiple Unique IDs (Coalesced Calls), all IDs share same buffer
+{
+	result_store.save(unique_ids, ResultStore::Buffer(new std::string("[1," + result + "]")));
+}
+
+
+bool Ext::parseProtocolOptions(const std::string &protocol_name, const std::string &options, ProtocolEntry &protocol_entry)
+// Options for 9:ADD are comma separated Key=Value pairs i.e Lane=Bulk,maxConcurrency=2,Coalesce=true,Timeout=30
+{
+	protocol_entry.lane = 0;
+	protocol_entry.coalesce = false;
+	protocol_entry.timeout = default_timeout;
+	protocol_entry.database = default_database;
+	protocol_entry.read_your_writes = false;
+	protocol_entry.native = false;
+
+	bool write_behind = false;
+	bool group_commit = false;
+	int flush_size = 100;
+	int flush_delay = 100;
+	int group_commit_delay = 0;
+
+	Poco::StringTokenizer option_tokens(options, ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+	for (Poco::StringTokenizer::Iterator it = option_tokens.begin(); it != option_tokens.end(); ++it)
+	{
+		const std::string::size_type found = it->find("=");
+		if (found == std::string::npos)
+		{
+			pLogger->warning("Invalid Protocol Option: " + *it);
+			return false;
+		}
+		const std::string key = boost::algorithm::trim_copy(it->substr(0, found));
+		const std::string value = boost::algorithm::trim_copy(it->substr(found+1));
+		if (boost::iequals(key, "Lane") == 1)
+		{
+			if (!findWorkerLane(value, protocol_entry.lane))
+			{
+				pLogger->warning("Unknown Worker Lane: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "maxConcurrency") == 1)
+		{
+			int max_concurrency;
+			if ((!Poco::NumberParser::tryParse(value, max_concurrency)) || (max_concurrency <= 0))
+			{
+				pLogger->warning("Invalid maxConcurrency: " + value);
+				return false;
+			}
+			protocol_entry.limiter.reset(new ConcurrencyLimiter(max_concurrency));
+		}
+		else if (boost::iequals(key, "Timeout") == 1)
+		{
+			if ((!Poco::NumberParser::tryParse(value, protocol_entry.timeout)) || (protocol_entry.timeout < 0))
+			{
+				pLogger->warning("Invalid Timeout: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "Database") == 1)
+		{
+			std::map< std::string, boost::shared_ptr<Database> >::iterator database_itr = databases.find(value);
+			if (database_itr == databases.end())
+			{
+				pLogger->warning("Unknown Database: " + value);
+				return false;
+			}
+			protocol_entry.database = database_itr->second;
+		}
+		else if (boost::iequals(key, "ReadYourWrites") == 1)
+		{
+			if ((boost::iequals(value, "true") == 1) || (value == "1"))
+			{
+				protocol_entry.read_your_writes = true;
+			}
+			else if ((boost::iequals(value, "false") == 1) || (value == "0"))
+			{
+				protocol_entry.read_your_writes = false;
+			}
+			else
+			{
+				pLogger->warning("Invalid ReadYourWrites: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "WriteBehind") == 1)
+		// Only use for 1: calls, calls are batched into one transaction per batch
+		{
+			if ((boost::iequals(value, "true") == 1) || (value == "1"))
+			{
+				write_behind = true;
+			}
+			else if ((boost::iequals(value, "false") == 1) || (value == "0"))
+			{
+				write_behind = false;
+			}
+			else
+			{
+				pLogger->warning("Invalid WriteBehind: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "GroupCommit") == 1)
+		// Only use for 2: write calls, calls waiting at the same time share one transaction
+		{
+			if ((boost::iequals(value, "true") == 1) || (value == "1"))
+			{
+				group_commit = true;
+			}
+			else if ((boost::iequals(value, "false") == 1) || (value == "0"))
+			{
+				group_commit = false;
+			}
+			else
+			{
+				pLogger->warning("Invalid GroupCommit: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "GroupCommitDelay") == 1)
+		{
+			if ((!Poco::NumberParser::tryParse(value, group_commit_delay)) || (group_commit_delay < 0))
+			{
+				pLogger->warning("Invalid GroupCommitDelay: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "FlushSize") == 1)
+		{
+			if ((!Poco::NumberParser::tryParse(value, flush_size)) || (flush_size <= 0))
+			{
+				pLogger->warning("Invalid FlushSize: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "FlushDelay") == 1)
+		{
+			if ((!Poco::NumberParser::tryParse(value, flush_delay)) || (flush_delay < 0))
+			{
+				pLogger->warning("Invalid FlushDelay: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "Native") == 1)
+		// MySQL -- DB_RAW_V2 + DB_CUSTOM_V2 stream results from C API straight into SQF result
+		{
+			if ((boost::iequals(value, "true") == 1) || (value == "1"))
+			{
+				protocol_entry.native = true;
+			}
+			else if ((boost::iequals(value, "false") == 1) || (value == "0"))
+			{
+				protocol_entry.native = false;
+			}
+			else
+			{
+				pLogger->warning("Invalid Native: " + value);
+				return false;
+			}
+		}
+		else if (boost::iequals(key, "Coalesce") == 1)
+		// Only use for read only calls, a duplicate call gets result of the call already in flight
+		{
+			if ((boost::iequals(value, "true") == 1) || (value == "1"))
+			{
+				protocol_entry.coalesce = true;
+			}
+			else if ((boost::iequals(value, "false") == 1) || (value == "0"))
+			{
+				protocol_entry.coalesce = false;
+			}
+			else
+			{
+				pLogger->warning("Invalid Coalesce: " + value);
+				return false;
+			}
+		}
+		else
+		{
+			pLogger->warning("Unknown Protocol Option: " + key);
+			return false;
+		}
+	}
+	if (group_commit && protocol_entry.coalesce)
+	{
+		pLogger->warning("GroupCommit can't be used with Coalesce");
+		return false;
+	}
+	if (write_behind)
+	{
+		protocol_entry.write_behind.reset(new WriteBehindQueue(protocol_name, flush_size, flush_delay));
+	}
+	if (group_commit)
+	{
+		protocol_entry.group_commit.reset(new GroupCommitQueue(protocol_name, flush_size, group_commit_delay));
+	}
+	return true;
+}
+
+
+void Ext::addProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &protocol_name, const std::string &init_data, const std::string &options)
+// Only called from arma main thread, protocol_registry publishes new snapshot once Protocol is initialized
+{
+	ProtocolEntry protocol_entry;
+	if (!parseProtocolOptions(protocol_name, options, protocol_entry))
+	{
+		std::strcpy(output, "[0,\"Error Invalid Protocol Options\"]");
+		return;
+	}
+
+	// TODO Implement Poco ClassLoader -- dayz hive ext has it to load database dll
+	boost::shared_ptr<AbstractProtocol> protocol_ptr;
+	std::string deprecated_msg;
+
+	if (boost::iequals(protocol, std::string("MISC")) == 1)
+	{
+		protocol_ptr.reset(new MISC());
+	}
+	else if (boost::iequals(protocol, std::string("DB_BASIC")) == 1)
+	{
+		protocol_ptr.reset(new DB_BASIC());
+		deprecated_msg = "DB_BASIC is Deprecated... Update SQF code for DB_BASIC_V2";
+	}
+	else if (boost::iequals(protocol, std::string("DB_BASIC_V2")) == 1)
+	{
+		protocol_ptr.reset(new DB_BASIC_V2());
+	}
+	else if (boost::iequals(protocol, std::string("DB_PROCEDURE")) == 1)
+	{
+		protocol_ptr.reset(new DB_PROCEDURE());
+		deprecated_msg = "DB_PROCEDURE is Deprecated... Update SQF code for DB_PROCEDURE_V2";
+	}
+	else if (boost::iequals(protocol, std::string("DB_PROCEDURE_V2")) == 1)
+	{
+		protocol_ptr.reset(new DB_PROCEDURE_V2());
+	}
+	else if (boost::iequals(protocol, std::string("DB_RAW")) == 1)
+	{
+		protocol_ptr.reset(new DB_RAW());
+		deprecated_msg = "DB_RAW is Deprecated... Update SQF code for DB_RAW_V2";
+	}
+	else if (boost::iequals(protocol, std::string("DB_RAW_V2")) == 1)
+	{
+		protocol_ptr.reset(new DB_RAW_V2());
+	}
+	else if (boost::iequals(protocol, std::string("DB_RAW_NO_EXTRA_QUOTES")) == 1)
+	{
+		protocol_ptr.reset(new DB_RAW_NO_EXTRA_QUOTES());
+		deprecated_msg = "DB_RAW_NO_EXTRA_QUOTES is Deprecated... Update SQF code for DB_RAW_NO_EXTRA_QUOTES_V2";
+	}
+	else if (boost::iequals(protocol, std::string("DB_RAW_NO_EXTRA_QUOTES_V2")) == 1)
+	{
+		protocol_ptr.reset(new DB_RAW_NO_EXTRA_QUOTES_V2());
+	}
+	else if (boost::iequals(protocol, std::string("DB_CUSTOM_V2")) == 1)
+	{
+		protocol_ptr.reset(new DB_CUSTOM_V2());
+	}
+	else if (boost::iequals(protocol, std::string("LOG")) == 1)
+	{
+		protocol_ptr.reset(new LOG());
+	}
+
+	if (!protocol_ptr)
+	{
+		std::strcpy(output, "[0,\"Error Unknown Protocol\"]");
+	}
+	else
+	{
+		// Protocol checks its Database in init
+		bool protocol_loaded;
+		{
+			CallScope call_scope(this, &protocol_entry);
+			protocol_loaded = protocol_ptr->init(this, init_data);
+		}
+		if (!protocol_loaded)
+		// Class Instance is never published if Failed to Load
+		{
+			std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
+			return;
+		}
+
+		protocol_entry.protocol = protocol_ptr;
+		protocol_registry.add(protocol_name, protocol_entry);
+		if (protocol_entry.group_commit || protocol_entry.write_behind)
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_write_behind);
+			if (protocol_entry.group_commit)
+			{
+				group_commit_queues.push_back(protocol_entry.group_commit);
+			}
+			if (protocol_entry.write_behind)
+			{
+				write_behind_queues.push_back(protocol_entry.write_behind);
+			}
+			if (!write_behind_running)
+			{
+				write_behind_running = true;
+				write_behind_thread = boost::thread(boost::bind(&Ext::runWriteBehind, this));
+			}
+		}
+		std::strcpy(output, "[1]");
+		if (!deprecated_msg.empty())
+		{
+			pLogger->warning(deprecated_msg);
+		}
+	}
+}
+
+
+void Ext::syncCallProtocol(char *output, const int &output_size, const boost::string_ref &protocol, const boost::string_ref &data)
+// Sync callPlugin
+//   Only called from arma main thread, so reuses sync_data_str + sync_result_str (no heap allocation once buffers are big enough)
+{
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+	if (protocol_entry == NULL)
+	{
+		std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
+	}
+	else
+	{
+		// Checks if Result String will fit into arma output char
+		//   If <=, then sends output to arma
+		//   if >, then sends ID Message arma + stores rest. (mutex locks)
+		sync_data_str.assign(data.data(), data.size());
+		sync_result_str.clear();
+		callProtocol(*protocol_entry, sync_data_str, sync_result_str);
+
+		OutputWriter writer(output, output_size);
+		if (sync_result_str.length() <= (output_size-9))
+		{
+			writer.append("[1, ").append(sync_result_str).append("]");
+		}
+		else
+		{
+			const int unique_id = getUniqueID_mutexlock();
+			if (unique_id == -1)
+			{
+				writer.append("[0,\"Error Unique IDs Exhausted\"]");
+			}
+			else
+			{
+				saveResult_mutexlock(sync_result_str, unique_id);
+				writer.append("[2,\"").append(unique_id).append("\"]");
+			}
+		}
+	}
+}
+
+
+void Ext::onewayCallProtocol(const std::string protocol, const std::string data)
+// ASync callProtocol
+{
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+	if (protocol_entry != NULL)
+	{
+		std::string result;
+		result.reserve(2000);
+		callProtocol(*protocol_entry, data, result);
+	}
+}
+
+
+void Ext::asyncCallProtocol(const std::string protocol, const std::string data, const int unique_id)
+// ASync + Save callProtocol
+//   Protocol was checked before job was queued, lookup again here since registry is lock free
+{
+	std::string result;
+	result.reserve(2000);
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+	if (protocol_entry == NULL)
+	{
+		result = "[0,\"Error Unknown Protocol\"]";
+	}
+	else
+	{
+		callProtocol(*protocol_entry, data, result);
+	}
+	saveResult_mutexlock(result, unique_id);
+}
+
+
+void Ext::batchCallProtocol(const boost::shared_ptr< std::vector<ProtocolCall> > calls, const int unique_id)
+// ASync + Save Batch of callProtocol, runs calls in order on one worker thread
+//   Result = array of each call result, same order as input
+{
+	std::string result;
+	result.reserve(2000);
+	std::string call_result;
+	call_result.reserve(2000);
+
+	result = "[";
+	for (std::vector<ProtocolCall>::const_iterator it = calls->begin(); it != calls->end(); ++it)
+	{
+		call_result.clear();
+		const ProtocolEntry *protocol_entry = protocol_registry.find(it->protocol);
+		if (protocol_entry == NULL)
+		{
+			call_result = "[0,\"Error Unknown Protocol\"]";
+		}
+		else
+		{
+			callProtocol(*protocol_entry, it->data, call_result);
+		}
+		if (it != calls->begin())
+		{
+			result += ",";
+		}
+		result += call_result;
+	}
+	result += "]";
+	saveResult_mutexlock(result, unique_id);
+}
+
+
+void Ext::coalescedCallProtocol(const std::string protocol, const std::string data, const std::string call_key)
+// ASync + Save callProtocol for Protocols with Coalesce option
+//   Result is saved for every Unique ID that attached while call was in flight
+//   In flight entry is always erased, if protocol throws every attached ticket gets [0,"Error Protocol Exception"]
+{
+	std::string result;
+	result.reserve(2000);
+	std::string error_str;
+	try
+	{
+		const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+		if (protocol_entry == NULL)
+		{
+			result = "[0,\"Error Unknown Protocol\"]";
+		}
+		else
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_BASIC());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
-				pLogger->warning("DB_BASIC is Deprecated... Update SQF code for DB_BASIC_V2");
-			}
+			callProtocol(*protocol_entry, data, result);
 		}
-		else if (boost::iequals(protocol, std::string("DB_BASIC_V2")) == 1)
+	}
+	catch (Poco::Exception& e)
+	{
+		error_str = e.displayText();
+	}
+	catch (std::exception& e)
+	{
+		error_str = e.what();
+	}
+	catch (...)
+	{
+		error_str = "Unknown Exception";
+	}
+
+	// Calls arriving after this point start a new query
+	std::vector<int> unique_ids;
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_in_flight);
+		boost::unordered_map< std::string, std::vector<int> >::iterator it = unordered_map_in_flight.find(call_key);
+		unique_ids.swap(it->second);
+		unordered_map_in_flight.erase(it);
+	}
+	if (error_str.empty())
+	{
+		saveResult_mutexlock(result, unique_ids);
+	}
+	else
+	{
+		#ifdef TESTING
+			std::cout << "extDB: Coalesced Call Error: " << error_str << std::endl;
+		#endif
+		pLogger->error("Coalesced Call " + protocol + " failed, " + Poco::NumberFormatter::format(unique_ids.size()) + " calls: " + error_str);
+		// Extension error, saved as is (not wrapped in [1,...])
+		result_store.save(unique_ids, ResultStore::Buffer(new std::string("[0,\"Error Protocol Exception\"]")));
+	}
+}
+
+
+void Ext::runWriteBehind()
+// Flush Thread, sleeps until oldest batch is Flush Delay old or a Group Commit is GroupCommitDelay old
+{
+	boost::unique_lock<boost::mutex> lock(mutex_write_behind);
+	while (write_behind_running)
+	{
+		const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+		boost::chrono::steady_clock::time_point next_due = boost::chrono::steady_clock::time_point::max();
+		std::vector< std::pair<std::string, WriteBehindQueue::Batch> > due_batches;
+		for (std::vector< boost::shared_ptr<WriteBehindQueue> >::iterator it = write_behind_queues.begin(); it != write_behind_queues.end(); ++it)
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_BASIC_V2());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
+			WriteBehindQueue::Batch due_batch;
+			if ((*it)->takeDue(now, due_batch, next_due))
 			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
+				due_batches.push_back(std::make_pair((*it)->protocolName(), due_batch));
 			}
 		}
-		else if (boost::iequals(protocol, std::string("DB_PROCEDURE")) == 1)
+		std::vector< boost::shared_ptr<GroupCommitQueue> > due_group_commits;
+		for (std::vector< boost::shared_ptr<GroupCommitQueue> >::iterator it = group_commit_queues.begin(); it != group_commit_queues.end(); ++it)
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_PROCEDURE());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
+			if ((*it)->takeDue(now, next_due))
 			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
-				pLogger->warning("DB_PROCEDURE is Deprecated... Update SQF code for DB_PROCEDURE_V2");
+				due_group_commits.push_back(*it);
 			}
 		}
-		else if (boost::iequals(protocol, std::string("DB_PROCEDURE_V2")) == 1)
+
+		if ((!due_batches.empty()) || (!due_group_commits.empty()))
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_PROCEDURE_V2());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
+			lock.unlock();
+			for (std::vector< std::pair<std::string, WriteBehindQueue::Batch> >::iterator it = due_batches.begin(); it != due_batches.end(); ++it)
 			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
+				flushWriteBehind(it->first, it->second);
 			}
-			else
+			for (std::vector< boost::shared_ptr<GroupCommitQueue> >::iterator it = due_group_commits.begin(); it != due_group_commits.end(); ++it)
 			{
-				std::strcpy(output, "[1]");
+				flushGroupCommit(*it);
 			}
+			lock.lock();
 		}
-		else if (boost::iequals(protocol, std::string("DB_RAW")) == 1)
+		else if (next_due == boost::chrono::steady_clock::time_point::max())
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_RAW());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
-				pLogger->warning("DB_RAW is Deprecated... Update SQF code for DB_RAW_V2");
-			}
+			cond_write_behind.wait(lock);
 		}
-		else if (boost::iequals(protocol, std::string("DB_RAW_V2")) == 1)
+		else
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_RAW_V2());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
-			}
+			cond_write_behind.wait_until(lock, next_due);
+		}
+	}
+}
+
+
+void Ext::flushWriteBehind(const std::string &protocol_name, const WriteBehindQueue::Batch &batch)
+// Queues batch on Protocol Worker Lane, same as a single 1: call (Timeout covers whole batch)
+{
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol_name);
+	if (protocol_entry != NULL)
+	{
+		postJob(*protocol_entry, withDeadline(boost::bind(&Ext::writeBehindCallProtocol, this, protocol_name, batch), protocol_entry->timeout, -1));
+	}
+}
+
+
+void Ext::writeBehindCallProtocol(const std::string protocol, const WriteBehindQueue::Batch batch)
+// Runs batch of 1: calls on one Session inside one transaction, so batch pays for one commit (+ fsync) instead of one per call
+//   A failed call only loses its own statement, batch is lost if commit fails (logged)
+{
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+	if (protocol_entry == NULL)
+	{
+		return;
+	}
+
+	CallScope call_scope(this, protocol_entry);
+	boost::scoped_ptr<Poco::Data::Session> session;
+	try
+	{
+		session.reset(new Poco::Data::Session(getSession(false)));
+		session->begin();
+		call_scope.call_context.session = session.get();
+
+		std::string result;
+		result.reserve(2000);
+		for (std::vector<std::string>::const_iterator it = batch->begin(); it != batch->end(); ++it)
+		{
+			result.clear();
+			protocol_entry->protocol->callProtocol(this, *it, result);
 		}
-		else if (boost::iequals(protocol, std::string("DB_RAW_NO_EXTRA_QUOTES")) == 1)
+		session->commit();
+		++write_behind_batches;
+	}
+	catch (Poco::Exception& e)
+	{
+		#ifdef TESTING
+			std::cout << "extDB: Write Behind Error: " << e.displayText() << std::endl;
+		#endif
+		pLogger->error("Write Behind " + protocol + " failed, lost " + Poco::NumberFormatter::format(batch->size()) + " calls: " + e.displayText());
+		++write_behind_failed;
+		try
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_RAW_NO_EXTRA_QUOTES());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
+			if (session && session->isTransaction())
 			{
-				std::strcpy(output, "[1]");
-				pLogger->warning("DB_RAW_NO_EXTRA_QUOTES is Deprecated... Update SQF code for DB_RAW_NO_EXTRA_QUOTES_V2");
+				session->rollback();
 			}
 		}
-		else if (boost::iequals(protocol, std::string("DB_RAW_NO_EXTRA_QUOTES_V2")) == 1)
+		catch (Poco::Exception&)
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_RAW_NO_EXTRA_QUOTES_V2());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
-			{
-				std::strcpy(output, "[1]");
-			}
 		}
-		else if (boost::iequals(protocol, std::string("DB_CUSTOM_V2")) == 1)
+	}
+}
+
+
+void Ext::queueGroupCommit(const ProtocolEntry &protocol_entry, const std::string &protocol)
+// Caller owns the commit job (add() / finish() returned true)
+//   With GroupCommitDelay flush thread queues it later, so calls arriving right behind can join batch without a Worker sleeping
+//   Once flush thread stopped (shutdown drain) job is queued straight away
+{
+	if (protocol_entry.group_commit->delay().count() > 0)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_write_behind);
+		if (write_behind_running)
+		{
+			protocol_entry.group_commit->schedule();
+			cond_write_behind.notify_all();
+			return;
+		}
+	}
+	postJob(protocol_entry, withDeadline(boost::bind(&Ext::groupCommitCallProtocol, this, protocol, protocol_entry.group_commit), protocol_entry.timeout, -1));
+}
+
+
+void Ext::flushGroupCommit(const boost::shared_ptr<GroupCommitQueue> &group_commit)
+// Queues scheduled commit job on Protocol Worker Lane
+{
+	const ProtocolEntry *protocol_entry = protocol_registry.find(group_commit->protocolName());
+	if (protocol_entry != NULL)
+	{
+		postJob(*protocol_entry, withDeadline(boost::bind(&Ext::groupCommitCallProtocol, this, group_commit->protocolName(), group_commit), protocol_entry->timeout, -1));
+	}
+	else
+	{
+		GroupCommitQueue::Batch batch;
+		group_commit->abandon(batch);
+		resolveGroupCommit(*batch, "[0,\"Error Unknown Protocol\"]");
+	}
+}
+
+
+void Ext::groupCommitCallProtocol(const std::string protocol, const boost::shared_ptr<GroupCommitQueue> group_commit)
+// Runs waiting 2: calls on one Session inside one transaction, batch pays for one commit (+ fsync) instead of one per call
+//   Results are held until commit succeeded, so a ticket never reports a write that could still be rolled back
+//   A failed call only loses its own statement, if commit fails every ticket in batch gets [0,"Error Commit Failed"]
+//   Every exit path resolves the batch + calls finish(), else later calls of this Protocol would never get a commit job
+{
+	GroupCommitQueue::Batch batch;
+	group_commit->take(batch);
+	std::vector<std::string> results(batch->size());
+
+	const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+	bool committed = false;
+	if (protocol_entry != NULL)
+	{
+		CallScope call_scope(this, protocol_entry);
+		std::string error_str;
+		boost::scoped_ptr<Poco::Data::Session> session;
+		try
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new DB_CUSTOM_V2());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
-			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
-			}
-			else
+			session.reset(new Poco::Data::Session(getSession(false)));
+			session->begin();
+			call_scope.call_context.session = session.get();
+
+			for (std::size_t i = 0; i < batch->size(); ++i)
 			{
-				std::strcpy(output, "[1]");
+				results[i].reserve(2000);
+				protocol_entry->protocol->callProtocol(this, (*batch)[i].data, results[i]);
 			}
+			session->commit();
+			committed = true;
+			++group_commits;
+			group_commit_calls += batch->size();
 		}
-		else if (boost::iequals(protocol, std::string("LOG")) == 1)
+		catch (Poco::Exception& e)
 		{
-			unordered_map_protocol[protocol_name] = boost::shared_ptr<AbstractProtocol> (new LOG());
-			if (!unordered_map_protocol[protocol_name].get()->init(this, init_data))
-			// Remove Class Instance if Failed to Load
+			error_str = e.displayText();
+		}
+		catch (std::exception& e)
+		{
+			error_str = e.what();
+		}
+		catch (...)
+		{
+			error_str = "Unknown Exception";
+		}
+		if (!committed)
+		{
+			#ifdef TESTING
+				std::cout << "extDB: Group Commit Error: " << error_str << std::endl;
+			#endif
+			pLogger->error("Group Commit " + protocol + " failed, " + Poco::NumberFormatter::format(batch->size()) + " calls: " + error_str);
+			++group_commit_failed;
+			try
 			{
-				unordered_map_protocol.erase(protocol_name);
-				std::strcpy(output, "[0,\"Failed to Load Protocol\"]");
+				if (session && session->isTransaction())
+				{
+					session->rollback();
+				}
 			}
-			else
+			catch (...)
 			{
-				std::strcpy(output, "[1]");
 			}
 		}
-		else
+	}
+
+	if (committed)
+	{
+		for (std::size_t i = 0; i < batch->size(); ++i)
 		{
-			std::strcpy(output, "[0,\"Error Unknown Protocol\"]");
+			saveResult_mutexlock(results[i], (*batch)[i].unique_id);
 		}
 	}
-}
-
+	else
+	{
+		resolveGroupCommit(*batch, ((protocol_entry != NULL) ? "[0,\"Error Commit Failed\"]" : "[0,\"Error Unknown Protocol\"]"));
+	}
 
-void Ext::syncCallProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &data)
-// Sync callPlugin
-{
-	boost::unordered_map< std::string, boost::shared_ptr<AbstractProtocol> >::const_iterator itr = unordered_map_protocol.find(protocol);
-    if (itr == unordered_map_protocol.end())
-    {
-        std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
-    }
-    else
-    {
-		// Checks if Result String will fit into arma output char
-		//   If <=, then sends output to arma
-		//   if >, then sends ID Message arma + stores rest. (mutex locks)
-		std::string result;
-		result.reserve(2000);
-        itr->second->callProtocol(this, data, result);
-		if (result.length() <= (output_size-9))
+	if (group_commit->finish())
+	{
+		if (protocol_entry != NULL)
 		{
-			std::strcpy(output, ("[1, " + result + "]").c_str());
+			// Calls arrived while committing, next batch goes to back of Worker Lane like any other job
+			queueGroupCommit(*protocol_entry, protocol);
 		}
 		else
 		{
-			const int unique_id = getUniqueID_mutexlock();
-			saveResult_mutexlock(result, unique_id);
-			std::strcpy(output, ("[2,\"" + Poco::NumberFormatter::format(unique_id) + "\"]").c_str());
+			group_commit->abandon(batch);
+			resolveGroupCommit(*batch, "[0,\"Error Unknown Protocol\"]");
 		}
-    }
-}
-
-
-void Ext::onewayCallProtocol(const std::string protocol, const std::string data)
-// ASync callProtocol
-{
-	boost::unordered_map< std::string, boost::shared_ptr<AbstractProtocol> >::const_iterator itr = unordered_map_protocol.find(protocol);
-    if (itr != unordered_map_protocol.end())
-    {
-		std::string result;
-		result.reserve(2000);
-        itr->second->callProtocol(this, data, result);
-    }
+	}
 }
 
 
-void Ext::asyncCallProtocol(const std::string protocol, const std::string data, const int unique_id)
-// ASync + Save callProtocol
-// We check if Protocol exists here, since its a thread (less time spent blocking arma) and it shouldnt happen anyways
+void Ext::resolveGroupCommit(const std::vector<GroupCommitQueue::Call> &calls, const std::string &error)
+// Extension errors are saved as is (not wrapped in [1,...]), same shape as [0,"Error Timeout"] from watchdog
 {
-	std::string result;
-	result.reserve(2000);
-	unordered_map_protocol[protocol].get()->callProtocol(this, data, result);
-	saveResult_mutexlock(result, unique_id);
+	const ResultStore::Buffer error_result(new std::string(error));
+	for (std::vector<GroupCommitQueue::Call>::const_iterator it = calls.begin(); it != calls.end(); ++it)
+	{
+		result_store.save(it->unique_id, error_result);
+	}
 }
 
 
 void Ext::callExtenion(char *output, const int &output_size, const char *function)
 {
-    try
-    {
+	try
+	{
 		#ifdef DEBUG_LOGGING
 			pLogger->trace("Extension Input from Server: " +  std::string(function));
 		#endif
-		const std::string input_str(function);
+		// Non-owning view of input, only copied when data has to outlive this call (ASYNC)
+		const boost::string_ref input_str(function);
 		if (input_str.length() <= 2)
 		{
 			std::strcpy(output, ("[0,\"Error Invalid Message, (Message to short)\"]"));
 		}
 		else
 		{
-			const std::string sep_char(":");
-
-			// Async / Sync
-			const int async = Poco::NumberParser::parse(input_str.substr(0,1));
-
-			switch (async)  // TODO Profile using Numberparser versus comparsion of char[0] + if statement checking length of *function
+			switch (input_str[0])
 			{
-				case 2: //ASYNC + SAVE
+				case '2': //ASYNC + SAVE
+				case '8': //ASYNC + SAVE + TIMEOUT i.e 8:SECONDS:PROTOCOL:DATA
 				{
+					// Timeout, -1 = Protocol Timeout
+					std::size_t start = 2;
+					int timeout = -1;
+					if (input_str[0] == '8')
+					{
+						const std::size_t found_timeout = OutputParser::find(input_str, ':', 2);
+						if ((found_timeout == boost::string_ref::npos) || (!OutputParser::parseInt(input_str.substr(2, (found_timeout-2)), timeout)) || (timeout < 0))
+						{
+							std::strcpy(output, ("[0,\"Error Invalid Format\"]"));
+							break;
+						}
+						start = found_timeout + 1;
+					}
+
 					// Protocol
-					const std::string::size_type found = input_str.find(sep_char,2);
+					const std::size_t found = OutputParser::find(input_str, ':', start);
 
-					if (found==std::string::npos)  // Check Invalid Format
+					if (found==boost::string_ref::npos)  // Check Invalid Format
 					{
 						std::strcpy(output, ("[0,\"Error Invalid Format\"]"));
 					}
 					else
 					{
-						bool found_procotol = false;
-						const std::string protocol = input_str.substr(2,(found-2));
-						// Data
-						std::string data = input_str.substr(found+1);
-						int unique_id = getUniqueID_mutexlock();
+						const boost::string_ref protocol = input_str.substr(start,(found-start));
+						// Check for Protocol Name Exists
+						//   Only Add Job to Work Queue + Return ID if Protocol Name exists.
+						const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+						if (protocol_entry == NULL)
+						{
+							std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
+						}
+						else if (!admitJob(*protocol_entry, true))
+						{
+							std::strcpy(output, ("[4]"));
+						}
+						else
 						{
-							boost::lock_guard<boost::mutex> lock(mutex_unordered_map_results);
-							// Check for Protocol Name Exists
-							if (unordered_map_protocol.find(protocol) == unordered_map_protocol.end())
+							const int unique_id = getUniqueID_mutexlock();
+							if (unique_id == -1)
+							// All Unique IDs in use
 							{
-								std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
+								++shed_pending_results;
+								std::strcpy(output, ("[4]"));
 							}
 							else
 							{
-								unordered_map_wait[unique_id] = true;
-								found_procotol = true;
+								result_store.wait(unique_id);
+								const int job_timeout = (timeout >= 0) ? timeout : protocol_entry->timeout;
+								// Data
+								if (protocol_entry->group_commit && (input_str[0] == '2'))
+								{
+									// Only first call queues a commit job, 8: calls keep their own Timeout so run on their own
+									if (protocol_entry->group_commit->add(input_str.substr(found+1).to_string(), unique_id))
+									{
+										queueGroupCommit(*protocol_entry, protocol.to_string());
+									}
+								}
+								else if (!protocol_entry->coalesce)
+								{
+									postJob(*protocol_entry, withDeadline(boost::bind(&Ext::asyncCallProtocol, this, protocol.to_string(), input_str.substr(found+1).to_string(), unique_id), job_timeout, unique_id));
+								}
+								else
+								{
+									// Key = PROTOCOL:DATA, only first call queues a job
+									const std::string call_key = input_str.substr(start).to_string();
+									bool in_flight;
+									{
+										boost::lock_guard<boost::mutex> lock(mutex_in_flight);
+										std::vector<int> &unique_ids = unordered_map_in_flight[call_key];
+										in_flight = !unique_ids.empty();
+										unique_ids.push_back(unique_id);
+									}
+									if (in_flight)
+									{
+										++coalesced_calls;
+									}
+									else
+									{
+										// Job saves result for all attached IDs, watchdog only cancels query
+										postJob(*protocol_entry, withDeadline(boost::bind(&Ext::coalescedCallProtocol, this, protocol.to_string(), input_str.substr(found+1).to_string(), call_key), job_timeout, -1));
+									}
+								}
+
+								OutputWriter writer(output, output_size);
+								writer.append("[2,\"").append(unique_id).append("\"]");
 							}
 						}
-						// Only Add Job to Work Queue + Return ID if Protocol Name exists.
-						if (found_procotol)
+					}
+					break;
+				}
+				case '4': // BATCH ASYNC + SAVE
+				{
+					// Calls are separated by ASCII 30 (Record Separator) i.e PROTOCOL:DATA<RS>PROTOCOL:DATA
+					//   All Protocols are checked before Job is added to Work Queue, one Unique ID for whole batch
+					//   Batch runs on Worker Lane + uses maxConcurrency limit + Timeout of first Protocol
+					boost::shared_ptr< std::vector<ProtocolCall> > calls(new std::vector<ProtocolCall>());
+					const ProtocolEntry *batch_entry = NULL;
+					bool valid_batch = true;
+					std::size_t start = 2;
+					while (start <= input_str.length())
+					{
+						std::size_t end = OutputParser::find(input_str, '\x1E', start);
+						if (end == boost::string_ref::npos)
+						{
+							end = input_str.length();
+						}
+						const boost::string_ref call_str = input_str.substr(start, (end-start));
+						const std::size_t found = OutputParser::find(call_str, ':', 0);
+
+						if (found==boost::string_ref::npos)  // Check Invalid Format
+						{
+							std::strcpy(output, ("[0,\"Error Invalid Format\"]"));
+							valid_batch = false;
+							break;
+						}
+
+						const ProtocolEntry *protocol_entry = protocol_registry.find(call_str.substr(0,found));
+						if (protocol_entry == NULL)
+						{
+							std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
+							valid_batch = false;
+							break;
+						}
+						if (calls->empty())
+						{
+							batch_entry = protocol_entry;
+						}
+						ProtocolCall call;
+						call.protocol = call_str.substr(0,found).to_string();
+						call.data = call_str.substr(found+1).to_string();
+						calls->push_back(call);
+						start = end + 1;
+					}
+
+					if (valid_batch && !admitJob(*batch_entry, true))
+					{
+						std::strcpy(output, ("[4]"));
+					}
+					else if (valid_batch)
+					{
+						const int unique_id = getUniqueID_mutexlock();
+						if (unique_id == -1)
+						// All Unique IDs in use
+						{
+							++shed_pending_results;
+							std::strcpy(output, ("[4]"));
+						}
+						else
 						{
-							io_service.post(boost::bind(&Ext::asyncCallProtocol, this, protocol, data, unique_id));
-							std::strcpy(output, (("[2,\"" + Poco::NumberFormatter::format(unique_id) + "\"]")).c_str());
+							result_store.wait(unique_id);
+							postJob(*batch_entry, withDeadline(boost::bind(&Ext::batchCallProtocol, this, calls, unique_id), batch_entry->timeout, unique_id));
+
+							OutputWriter writer(output, output_size);
+							writer.append("[2,\"").append(unique_id).append("\"]");
 						}
 					}
 					break;
 				}
-				case 5: // GET
+				case '5': // GET
+				{
+					int unique_id;
+					if (OutputParser::parseInt(input_str.substr(2), unique_id))
+					{
+						getResult_mutexlock(unique_id, output, output_size);
+					}
+					else
+					{
+						std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
+					}
+					break;
+				}
+				case '6': // GET MULTIPLE i.e 6:ID:ID:ID
+				{
+					getResults_mutexlock(input_str.substr(2), output, output_size);
+					break;
+				}
+				case '7': // COMPLETIONS i.e 7:CURSOR
 				{
-					const int unique_id = Poco::NumberParser::parse(input_str.substr(2));
-					getResult_mutexlock(unique_id, output, output_size);
+					getCompletions(input_str.substr(2), output, output_size);
 					break;
 				}
-				case 1: //ASYNC
+				case '1': //ASYNC
 				{
 					// Protocol
-					const std::string::size_type found = input_str.find(sep_char,2);
+					const std::size_t found = OutputParser::find(input_str, ':', 2);
 
-					if (found==std::string::npos)  // Check Invalid Format
+					if (found==boost::string_ref::npos)  // Check Invalid Format
 					{
 						std::strcpy(output, ("[0,\"Error Invalid Format\"]"));
 					}
 					else
 					{
-						const std::string protocol = input_str.substr(2,(found-2));
-						// Data
-						const std::string data = input_str.substr(found+1);
-						io_service.post(boost::bind(&Ext::onewayCallProtocol, this, protocol, data));
-						std::strcpy(output, "[1]");
+						const boost::string_ref protocol = input_str.substr(2,(found-2));
+						const ProtocolEntry *protocol_entry = protocol_registry.find(protocol);
+						if (protocol_entry == NULL)
+						{
+							std::strcpy(output, ("[0,\"Error Unknown Protocol\"]"));
+						}
+						else if (!admitJob(*protocol_entry, false))
+						{
+							std::strcpy(output, ("[4]"));
+						}
+						else if (protocol_entry->write_behind)
+						{
+							// Protocol + Data, queued until batch is full or Flush Delay old
+							WriteBehindQueue::Batch full_batch;
+							bool first_call;
+							if (protocol_entry->write_behind->add(input_str.substr(found+1).to_string(), full_batch, first_call))
+							{
+								flushWriteBehind(protocol_entry->write_behind->protocolName(), full_batch);
+							}
+							else if (first_call)
+							{
+								boost::lock_guard<boost::mutex> lock(mutex_write_behind);
+								cond_write_behind.notify_one();
+							}
+							std::strcpy(output, "[1]");
+						}
+						else
+						{
+							// Protocol + Data
+							postJob(*protocol_entry, withDeadline(boost::bind(&Ext::onewayCallProtocol, this, protocol.to_string(), input_str.substr(found+1).to_string()), protocol_entry->timeout, -1));
+							std::strcpy(output, "[1]");
+						}
 					}
 					break;
 				}
-				case 0: //SYNC
+				case '0': //SYNC
 				{
 					// Protocol
-					const std::string::size_type found = input_str.find(sep_char,2);
+					const std::size_t found = OutputParser::find(input_str, ':', 2);
 
-					if (found==std::string::npos)  // Check Invalid Format
+					if (found==boost::string_ref::npos)  // Check Invalid Format
 					{
 						std::strcpy(output, ("[0,\"Error Invalid Format\"]"));
 					}
 					else
 					{
-						const std::string protocol = input_str.substr(2,(found-2));
-						// Data
-						const std::string data = input_str.substr(found+1);
-						syncCallProtocol(output, output_size, protocol, data);
+						// Protocol + Data
+						syncCallProtocol(output, output_size, input_str.substr(2,(found-2)), input_str.substr(found+1));
 					}
 					break;
 				}
-				case 9:
+				case '9':
 				{
-					if (!extDB_lock)
+					if (input_str == boost::string_ref("9:STATS"))
+					// Read only, still available after 9:LOCK
+					{
+						getStats(output, output_size);
+					}
+					else if (!extDB_lock)
 					{
 						// Protocol
 
-						Poco::StringTokenizer tokens(input_str, ":");
+						Poco::StringTokenizer tokens(std::string(function), ":");
 						std::size_t token_count = tokens.count(); // TODO CHECK !!!!!!!!
 						
 						switch (token_count)
@@ -891,15 +2550,27 @@ void Ext::callExtenion(char *output, const int &output_size, const char *functio
 								break;
 							case 3:
 								// DATABASE
-								connectDatabase(output, output_size, tokens[2]);
+								connectDatabase(output, output_size, tokens[2], tokens[2]);
 								break;
 							case 4:
-								// ADD PROTOCOL
-								addProtocol(output, output_size, tokens[2], tokens[3], "");
+								if (tokens[1] == "DATABASE")
+								{
+									// DATABASE + NAME i.e 9:DATABASE:Database2:Stats
+									connectDatabase(output, output_size, tokens[2], tokens[3]);
+								}
+								else
+								{
+									// ADD PROTOCOL
+									addProtocol(output, output_size, tokens[2], tokens[3], "", "");
+								}
 								break;
 							case 5:
 								//ADD PROTOCOL
-								addProtocol(output, output_size, tokens[2], tokens[3], tokens[4]);
+								addProtocol(output, output_size, tokens[2], tokens[3], tokens[4], "");
+								break;
+							case 6:
+								//ADD PROTOCOL + OPTIONS i.e 9:ADD:DB_CUSTOM_V2:NAME:INIT:Lane=Bulk,maxConcurrency=2
+								addProtocol(output, output_size, tokens[2], tokens[3], tokens[4], tokens[5]);
 								break;
 							default:
 								// Invalid Format
@@ -913,16 +2584,16 @@ void Ext::callExtenion(char *output, const int &output_size, const char *functio
 					std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
 				}
 			}
-        }
-    }
-    catch (Poco::Exception& e)
-    {
-        std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
+		}
+	}
+	catch (Poco::Exception& e)
+	{
+		std::strcpy(output, ("[0,\"Error Invalid Message\"]"));
 		#ifdef TESTING
 			std::cout << "extDB: Error: " << e.displayText() << std::endl;
 		#endif
 		pLogger->error("extDB: Error: " + e.displayText());
-    }
+	}
 }
 
 
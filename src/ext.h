@@ -17,9 +17,12 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
-#include <boost/asio.hpp>
+#include <boost/chrono.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <Poco/AsyncChannel.h>
 #include <Poco/FormattingChannel.h>
@@ -28,27 +31,104 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <Poco/Thread.h>
 
+#include <map>
+#include <string>
+
+#include "executor.h"
+#include "output_writer.h"
+#include "protocol_registry.h"
+#include "result_store.h"
 #include "uniqueid.h"
+#include "write_behind.h"
 
 #include "protocols/abstract_ext.h"
 #include "protocols/abstract_protocol.h"
 
 
 class DBPool : public Poco::Data::SessionPool
+// Session Pool with bounded wait + adaptive size
+//   Poco SessionPool throws as soon as maxSessions are in use, acquire() waits upto maxWait ms for a session to be returned instead
+//   Sessions are only created upto a soft cap, it grows when callers have to wait + shrinks again when pool is quiet
+//   Arma main thread (SYNC calls) never waits, it gets an overflow session above soft cap instead (upto maxSessions)
+//   Soft cap stays between minSessions + maxSessions, Poco closes idle sessions above minSessions after idleTime
 {
 	public:
-		DBPool(const std::string& sessionKey, const std::string& connectionString, int minSessions, int maxSessions, int idleTime): Poco::Data::SessionPool(sessionKey, connectionString, minSessions, maxSessions, idleTime)
-		{
-		}
+		DBPool(const std::string& sessionKey, const std::string& connectionString, int minSessions, int maxSessions, int idleTime, int maxWait);
 		virtual ~DBPool()
 		{
 		}
 
+		Poco::Data::Session acquire(const bool &wait);  // Throws SessionPoolExhaustedException after maxWait, or straight away if wait = false
+
+		int softCap() const;
+		int waits() const;
+		int timeouts() const;
+		int creations() const;
+		int avgAcquireMicros() const;
 		
 	protected:
 		void customizeSession (Poco::Data::Session& session);
+
+	private:
+		boost::mutex mutex_acquire;
+		int pending_gets;  // Sessions reserved under mutex_acquire, get() runs after lock is released (can open a new connection)
+		int min_sessions;
+		int max_sessions;
+		int max_wait;
+
+		boost::atomic<int> soft_cap;
+		boost::atomic<int> session_waits;
+		boost::atomic<int> session_timeouts;
+		boost::atomic<int> session_creations;
+		boost::atomic<unsigned long long> acquires;
+		boost::atomic<unsigned long long> acquire_micros;
+
+		// Quiet Period -- soft cap shrinks by one after a period with no waits
+		boost::chrono::steady_clock::time_point quiet_since;
+		int quiet_waits;
+
+		void growSoftCap();
+		void recordAcquire(const boost::chrono::steady_clock::time_point &start, const bool &waited);
 };
 
+struct ThreadSession
+// Thread Sessions option, Session of one Worker Thread + Protocol caches tied to it
+{
+	ThreadSession(const std::string &db_type, const std::string &connection_str) : session(db_type, connection_str) {}
+
+	Poco::Data::Session session;
+	boost::unordered_map<const void*, boost::shared_ptr<SessionCache> > caches;  // Declared after session, so caches are destroyed before session closes
+};
+
+struct Database
+// Named Database, 9:DATABASE:CONF_OPTION or 9:DATABASE:CONF_OPTION:NAME (NAME defaults to CONF_OPTION)
+//   Each Database has its own pool + sizing, Protocols pick one via option i.e 9:ADD:DB_RAW_V2:NAME::Database=Stats
+{
+	std::string name;
+	std::string db_type;
+	std::string connection_str;
+	int min_sessions;
+	int max_sessions;
+	int idle_time;
+	int max_wait;
+	bool thread_sessions;
+
+	boost::shared_ptr<DBPool> pool;
+	boost::thread_specific_ptr<ThreadSession> thread_session;  // Thread Sessions option, see Ext::getThreadSession
+
+	// Read Replica -- Replica = SECTION option, read only calls use replica pool, everything else stays on this pool
+	//   Protocols with ReadYourWrites=true read from this pool for Replica Lag seconds after a write finished
+	//   last_write is one timestamp per Database, a write from any protocol / caller moves every ReadYourWrites read to this pool
+	std::string replica_connection_str;
+	boost::shared_ptr<DBPool> replica_pool;
+	boost::thread_specific_ptr<ThreadSession> replica_thread_session;
+	int replica_lag;
+	boost::atomic<long long> last_write;  // steady_clock ticks of last write call, started or finished
+	boost::atomic<int> replica_reads;
+	boost::atomic<int> primary_reads;
+};
+
+
 class Ext: public AbstractExt
 {
 	public:
@@ -66,11 +146,16 @@ class Ext: public AbstractExt
 		Poco::AutoPtr<Poco::Util::IniFileConfiguration> pConf;
 
 		Poco::Data::Session getDBSession_mutexlock();
+		Poco::Data::Session getDBReadSession_mutexlock();
 		void saveResult_mutexlock(const std::string &result, const int &unique_id);
+		void saveResult_mutexlock(const std::string &result, const std::vector<int> &unique_ids);
 		void stop();
 
 		std::string getAPIKey();
 		std::string getDBType();
+		bool useNativeEngine();
+		bool useThreadSessions();
+		boost::shared_ptr<SessionCache>* getSessionCache(Poco::Data::Session &session, const void *owner);
 
 		int getUniqueID_mutexlock();
 		void freeUniqueID_mutexlock(const int &unique_id);
@@ -81,50 +166,200 @@ class Ext: public AbstractExt
 		int max_threads;
 
 		std::string steam_api_key;
-		
-		struct DBConnectionInfo {
-			std::string db_type;
-			std::string connection_str;
-			int min_sessions;
-			int max_sessions;
-			int idle_time;
+
+		// Work Stealing Thread Pool -- one per Worker Lane, each Lane has its own threads
+		//   Lane 0 = Default Lane (Main.Threads), extra Lanes are defined in [Lanes] section
+		struct WorkerLane {
+			std::string name;
+			Executor executor;
 		};
-		
-		DBConnectionInfo db_conn_info;
+		std::vector< boost::shared_ptr<WorkerLane> > worker_lanes;
+
+		void createWorkerLane(const std::string &lane_name, int lane_threads);
+		bool findWorkerLane(const std::string &lane_name, std::size_t &lane);
+
+		void postJob(const ProtocolEntry &protocol_entry, const Executor::Job &job);
+
+		// Job Deadlines -- Timeout option for 9:ADD / 8:SECONDS:PROTOCOL:DATA, 0 = No Timeout
+		//   Watchdog thread cancels running query (MySQL KILL QUERY / sqlite3_interrupt) + resolves ticket with [0,"Error Timeout"]
+		struct JobContext;
+		typedef std::multimap<boost::chrono::steady_clock::time_point, boost::shared_ptr<JobContext> > Deadlines;
+		struct JobContext {
+			boost::mutex mutex;
+			int unique_id;   // Ticket resolved by watchdog, -1 = None (1: / Coalesced Calls, job saves result)
+			bool timed_out;  // Result of job is dropped
+			bool finished;
+			boost::shared_ptr<Poco::Data::Session> session;  // Held until job finishes, so watchdog never cancels a session back in pool
+			Database *database;  // Set with session, queries are cancelled on its Database
+			bool replica;
+			unsigned long mysql_thread_id;  // 0 = Unknown
+
+			// Guarded by mutex_deadlines, entry is dropped by watchdog once due or by job once finished
+			Deadlines::iterator deadline;
+			bool deadline_queued;
+		};
+		Deadlines deadlines;
+		boost::mutex mutex_deadlines;
+		boost::condition_variable cond_deadlines;
+		boost::thread deadline_thread;
+		bool deadlines_running;
+		int default_timeout;
+		boost::atomic<int> timed_out_jobs;
+
+		boost::thread_specific_ptr<JobContext> current_job;  // Set on Worker Thread while job with deadline runs
+		static void releaseJobContext(JobContext *job_context);
+
+		Executor::Job withDeadline(const Executor::Job &job, const int &timeout, const int &unique_id);
+		void runDeadlineJob(const boost::shared_ptr<JobContext> job_context, const Executor::Job job);
 
-		// ASIO Thread Queue
-		boost::shared_ptr<boost::asio::io_service::work> io_work_ptr;
-		boost::asio::io_service io_service;
-		boost::mutex mutex_io_service;
+		struct DeadlineScope : private boost::noncopyable
+		// Sets current_job while job runs, on scope exit (job can throw) job is finished, its Session goes back to pool + deadline is dropped
+		{
+			DeadlineScope(Ext *ext, const boost::shared_ptr<JobContext> &job_context);
+			~DeadlineScope();
+
+			Ext *ext;
+			boost::shared_ptr<JobContext> job_context;
+		};
+		void runDeadlines();
+		void trackSession(JobContext &job_context, Database &database, const bool &replica, Poco::Data::Session &session);
+		void cancelQuery(JobContext &job_context);
+		void finishDeadline(JobContext &job_context);
+		void runLimitedJob(const boost::shared_ptr<ConcurrencyLimiter> limiter, const std::size_t lane, const Executor::Job job);
+
+		struct LimiterSlot : private boost::noncopyable
+		// Releases maxConcurrency slot on scope exit (job can throw), next waiting job takes it over
+		{
+			LimiterSlot(Ext *ext, const boost::shared_ptr<ConcurrencyLimiter> &limiter, const std::size_t &lane) : ext(ext), limiter(limiter), lane(lane) {}
+			~LimiterSlot();
+
+			Ext *ext;
+			boost::shared_ptr<ConcurrencyLimiter> limiter;
+			std::size_t lane;
+		};
+
+		// Admission Control -- ASYNC calls get [4] (Busy, retry later) when over limits, 0 = Unlimited
+		int max_queued_jobs;      // Jobs waiting in a Worker Lane queue
+		int max_pending_results;  // Unique IDs waiting on a result or not fetched yet
+		boost::atomic<int> pending_results;
+		boost::atomic<int> shed_queue_full;
+		boost::atomic<int> shed_pending_results;
 
-		boost::thread_group threads;
+		// Shutdown -- stop() waits upto shutdown_timeout seconds for queued + running jobs
+		boost::atomic<bool> draining;
+		int shutdown_timeout;
 
-		// Database Session Pool
-		boost::shared_ptr<DBPool> db_pool;
-		boost::mutex mutex_db_pool;
+		bool admitJob(const ProtocolEntry &protocol_entry, const bool &save_result);
+		void getStats(char *output, const int &output_size);
+		bool writeStats(char *output, const int &output_size);
+
+		// Databases -- only changed + iterated from arma main thread, worker threads use Database of ProtocolEntry
+		std::map< std::string, boost::shared_ptr<Database> > databases;
+		boost::shared_ptr<Database> default_database;
+
+		// Protocol call currently running on this thread, set by callProtocol
+		struct CallContext {
+			const ProtocolEntry *protocol_entry;
+			bool wrote;  // Got a write session, Database last_write is updated once call finishes
+			Poco::Data::Session *session;  // Write Behind batch, every call of batch uses this session (+ its transaction)
+		};
+		boost::thread_specific_ptr<CallContext> current_call;
+		static void releaseCallContext(CallContext *call_context);
+
+		struct CallScope : private boost::noncopyable
+		// Sets current_call while a Protocol runs, previous call is restored on scope exit (Protocol can throw)
+		//   Database last_write is set here if call got a write session, also after a call that failed part way
+		{
+			CallScope(Ext *ext, const ProtocolEntry *protocol_entry);
+			~CallScope();
+
+			Ext *ext;
+			CallContext call_context;
+			CallContext *previous_call;
+		};
 
-		void connectDatabase(char *output, const int &output_size, const std::string &conf_option);
+		void callProtocol(const ProtocolEntry &protocol_entry, const std::string &data, std::string &result);
+		Database& getDatabase();
+		Poco::Data::Session getSession(const bool &read_only);
+
+		Poco::Data::Session getPoolSession(Database &database, const bool &replica);
+
+		// Thread Sessions -- Database option, each Worker Thread keeps its own Session (no pool lock on ASYNC calls)
+		//   Pool is then only used by SYNC calls from arma main thread. Session is closed when Worker Thread exits
+		boost::atomic<int> thread_sessions;  // Opened, includes reopened after lost connection
+
+		Poco::Data::Session& getThreadSession(Database &database, const bool &replica);
+
+		void connectDatabase(char *output, const int &output_size, const std::string &conf_option, const std::string &database_name);
+		bool connectReplica(const std::string &replica_option, Database &database);
+		void closeDatabase(Database &database);
+		std::string getConnectionString(const std::string &conf_option, const std::string &db_type);
 
 		void getResult_mutexlock(const int &unique_id, char *output, const int &output_size);
+		void getResults_mutexlock(const boost::string_ref &unique_ids, char *output, const int &output_size);
+		void getCompletions(const boost::string_ref &cursor_str, char *output, const int &output_size);
 		void sendResult_mutexlock(const std::string &result, char *output, const int &output_size);
 
-		// boost::unordered_map + mutex -- for Plugin Loaded
-		boost::unordered_map< std::string, boost::shared_ptr<AbstractProtocol> > unordered_map_protocol;
-		boost::mutex mutex_unordered_map_protocol;
+		// Protocols Loaded -- lock free lookups, see protocol_registry.h
+		ProtocolRegistry protocol_registry;
 
-		// boost::unordered_map + mutex -- for Stored Results to long for outputsize
-		boost::unordered_map<int, bool> unordered_map_wait;
-		boost::unordered_map<int, std::string> unordered_map_results;
-		boost::mutex mutex_unordered_map_results;  // Using Same Lock for Wait / Results / Plugins
+		// Stored Results -- waiting on a job or to long for outputsize, see result_store.h
+		ResultStore result_store;
 
-		// Unique ID for key for ^^
+		// Unique ID for key for ^^ (lock free, see uniqueid.h)
 		boost::shared_ptr<IdManager> mgr;
-		boost::mutex mutex_unique_id;
 
 		// Plugins
-		void addProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &protocol_name, const std::string &init_data);
+		void addProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &protocol_name, const std::string &init_data, const std::string &options);
+		bool parseProtocolOptions(const std::string &protocol_name, const std::string &options, ProtocolEntry &protocol_entry);
 
-		void syncCallProtocol(char *output, const int &output_size, const std::string &protocol, const std::string &data);
+		// Reused Buffers for SYNC calls (arma main thread only)
+		std::string sync_data_str;
+		std::string sync_result_str;
+
+		void syncCallProtocol(char *output, const int &output_size, const boost::string_ref &protocol, const boost::string_ref &data);
 		void onewayCallProtocol(const std::string protocol, const std::string data);
 		void asyncCallProtocol(const std::string protocol, const std::string data, const int unique_id);
+
+		// Batch Calls -- multiple PROTOCOL:DATA in one extension call, results saved under one Unique ID
+		struct ProtocolCall {
+			std::string protocol;
+			std::string data;
+		};
+		void batchCallProtocol(const boost::shared_ptr< std::vector<ProtocolCall> > calls, const int unique_id);
+
+		// Coalesced Calls -- PROTOCOL:DATA in flight => Unique IDs waiting on it, duplicates attach instead of queuing a job
+		boost::unordered_map< std::string, std::vector<int> > unordered_map_in_flight;
+		boost::mutex mutex_in_flight;
+		boost::atomic<int> coalesced_calls;
+
+		void coalescedCallProtocol(const std::string protocol, const std::string data, const std::string call_key);
+
+		// Write Behind -- 1: calls of Protocols with WriteBehind=true are queued + run in batches, one transaction per batch
+		//   Flush thread queues batches that are Flush Delay old, full batches are queued straight away
+		//   Flush thread also queues delayed Group Commit jobs, mutex_write_behind guards both queue lists
+		std::vector< boost::shared_ptr<WriteBehindQueue> > write_behind_queues;
+		boost::mutex mutex_write_behind;
+		boost::condition_variable cond_write_behind;
+		boost::thread write_behind_thread;
+		bool write_behind_running;
+		boost::atomic<int> write_behind_batches;
+		boost::atomic<int> write_behind_failed;
+
+		void runWriteBehind();
+		void flushWriteBehind(const std::string &protocol_name, const WriteBehindQueue::Batch &batch);
+		void writeBehindCallProtocol(const std::string protocol, const WriteBehindQueue::Batch batch);
+
+		// Group Commit -- 2: calls of Protocols with GroupCommit=true share one transaction with calls waiting at the same time
+		//   Results are only saved once the shared commit succeeded
+		boost::atomic<int> group_commits;
+		boost::atomic<int> group_commit_calls;
+		boost::atomic<int> group_commit_failed;
+
+		std::vector< boost::shared_ptr<GroupCommitQueue> > group_commit_queues;
+
+		void queueGroupCommit(const ProtocolEntry &protocol_entry, const std::string &protocol);
+		void flushGroupCommit(const boost::shared_ptr<GroupCommitQueue> &group_commit);
+		void groupCommitCallProtocol(const std::string protocol, const boost::shared_ptr<GroupCommitQueue> group_commit);
+		void resolveGroupCommit(const std::vector<GroupCommitQueue::Call> &calls, const std::string &error);
 };
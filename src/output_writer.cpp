@@ -0,0 +1,304 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "output_writer.h"
+
+#include <cstring>
+#include <limits>
+
+
+OutputWriter::OutputWriter(char *output, const int &output_size) : output(output), pos(0), overflow(false)
+{
+	if (output_size > 0)
+	{
+		max_size = output_size;
+	}
+	else
+	{
+		max_size = 0;
+	}
+	output[0] = '\0';
+}
+
+
+OutputWriter& OutputWriter::append(const char *str)
+{
+	return append(str, std::strlen(str));
+}
+
+
+OutputWriter& OutputWriter::append(const char *str, std::size_t len)
+{
+	if (len > (max_size - pos))
+	{
+		len = max_size - pos;
+		overflow = true;
+	}
+	std::memcpy(output + pos, str, len);
+	pos += len;
+	output[pos] = '\0';
+	return *this;
+}
+
+
+OutputWriter& OutputWriter::append(const boost::string_ref &str)
+{
+	return append(str.data(), str.size());
+}
+
+
+OutputWriter& OutputWriter::append(const std::string &str)
+{
+	return append(str.data(), str.size());
+}
+
+
+OutputWriter& OutputWriter::append(const int &value)
+{
+	// Formats backwards into small stack buffer
+	char buffer[12];
+	char *end = buffer + sizeof(buffer);
+	char *start = end;
+
+	unsigned int abs_value = (value < 0) ? (0u - static_cast<unsigned int>(value)) : static_cast<unsigned int>(value);
+	do
+	{
+		*(--start) = static_cast<char>('0' + (abs_value % 10));
+		abs_value /= 10;
+	} while (abs_value != 0);
+	if (value < 0)
+	{
+		*(--start) = '-';
+	}
+	return append(start, (end - start));
+}
+
+
+OutputWriter& OutputWriter::append(const unsigned long long &value)
+{
+	char buffer[21];
+	char *end = buffer + sizeof(buffer);
+	char *start = end;
+
+	unsigned long long remaining = value;
+	do
+	{
+		*(--start) = static_cast<char>('0' + (remaining % 10));
+		remaining /= 10;
+	} while (remaining != 0);
+	return append(start, (end - start));
+}
+
+
+std::size_t OutputWriter::length() const
+{
+	return pos;
+}
+
+
+bool OutputWriter::truncated() const
+{
+	return overflow;
+}
+
+
+std::size_t OutputParser::find(const boost::string_ref &str, const char c, const std::size_t pos)
+{
+	for (std::size_t index = pos; index < str.size(); ++index)
+	{
+		if (str[index] == c)
+		{
+			return index;
+		}
+	}
+	return boost::string_ref::npos;
+}
+
+
+bool OutputParser::parseInt(const boost::string_ref &str, int &value)
+{
+	if (str.empty() || (str.size() > 11))
+	{
+		return false;
+	}
+
+	std::size_t index = 0;
+	bool negative = false;
+	if (str[0] == '-')
+	{
+		negative = true;
+		++index;
+		if (index == str.size())
+		{
+			return false;
+		}
+	}
+
+	long long result = 0;
+	for (; index < str.size(); ++index)
+	{
+		if ((str[index] < '0') || (str[index] > '9'))
+		{
+			return false;
+		}
+		result = (result * 10) + (str[index] - '0');
+	}
+	if (negative)
+	{
+		result = -result;
+	}
+	if ((result > std::numeric_limits<int>::max()) || (result < std::numeric_limits<int>::min()))
+	{
+		return false;
+	}
+	value = static_cast<int>(result);
+	return true;
+}
+
+
+bool OutputParser::parseUInt64(const boost::string_ref &str, unsigned long long &value)
+{
+	if (str.empty() || (str.size() > 19))  // 19 digits always fits, no overflow check needed
+	{
+		return false;
+	}
+	unsigned long long result = 0;
+	for (std::size_t index = 0; index < str.size(); ++index)
+	{
+		if ((str[index] < '0') || (str[index] > '9'))
+		{
+			return false;
+		}
+		result = (result * 10) + (str[index] - '0');
+	}
+	value = result;
+	return true;
+}
+
+
+#ifdef TEST_OUTPUT_WRITER_APP
+
+#include <boost/chrono.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Counts Heap Allocations, only for this benchmark
+namespace
+{
+	unsigned long long allocation_count = 0;
+}
+
+void* operator new (std::size_t size)
+{
+	++allocation_count;
+	if (void *ptr = std::malloc(size == 0 ? 1 : size))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) throw ()
+{
+	std::free(ptr);
+}
+
+
+namespace
+{
+	// Stand-in for a small protocol (MISC TEST), echo data back
+	void echoProtocol(const std::string &input_str, std::string &result)
+	{
+		result = input_str;
+	}
+
+	// Dispatch path before: std::string copy of input + substr copies + temporary response string
+	void legacyCall(char *output, const int &output_size, const char *function)
+	{
+		const std::string input_str(function);
+		const std::string::size_type found = input_str.find(":", 2);
+		const std::string protocol = input_str.substr(2, (found-2));
+		const std::string data = input_str.substr(found+1);
+		if (protocol.empty())
+		{
+			return;
+		}
+		std::string result;
+		result.reserve(2000);
+		echoProtocol(data, result);
+		std::strcpy(output, ("[1, " + result + "]").c_str());
+	}
+
+	// Dispatch path after: views of input + buffers reused between sync calls + OutputWriter
+	std::string sync_data_str;
+	std::string sync_result_str;
+
+	void viewCall(char *output, const int &output_size, const char *function)
+	{
+		const boost::string_ref input_str(function);
+		const std::size_t found = OutputParser::find(input_str, ':', 2);
+		const boost::string_ref protocol = input_str.substr(2, (found-2));
+		const boost::string_ref data = input_str.substr(found+1);
+		if (protocol.empty())
+		{
+			return;
+		}
+		sync_data_str.assign(data.data(), data.size());
+		sync_result_str.clear();
+		echoProtocol(sync_data_str, sync_result_str);
+		OutputWriter writer(output, output_size);
+		writer.append("[1, ").append(sync_result_str).append("]");
+	}
+
+	void runBenchmark(const char *name, void (*call)(char *, const int &, const char *), const char *function, const int iterations)
+	{
+		char output[4096];
+		call(output, 4095, function); // Warmup
+		const unsigned long long start_count = allocation_count;
+		const boost::chrono::high_resolution_clock::time_point start = boost::chrono::high_resolution_clock::now();
+		for (int i = 0; i < iterations; ++i)
+		{
+			call(output, 4095, function);
+		}
+		const boost::chrono::nanoseconds elapsed = boost::chrono::high_resolution_clock::now() - start;
+		std::cout << name << ": " << output << std::endl;
+		std::cout << "    allocations/call: " << (double(allocation_count - start_count) / iterations);
+		std::cout << "    ns/call: " << (double(elapsed.count()) / iterations) << std::endl;
+	}
+}
+
+
+int main(int nNumberofArgs, char* pszArgs[])
+{
+	const int iterations = 1000000;
+	const char *inputs[] = {
+		"0:MISC:TIME",
+		"0:MISC:TEST:[\"76561197960287930\",\"Some Player Name\",[1,2,3]]",
+		"0:DB_CUSTOM:UpdatePlayer:[\"ItemMap\",\"ItemCompass\",\"ItemWatch\",\"ItemRadio\",\"ItemGPS\"]:[1234.56,5678.91,0]:\"UP\""
+	};
+	for (std::size_t i = 0; i < (sizeof(inputs) / sizeof(inputs[0])); ++i)
+	{
+		std::cout << std::endl << "Input: " << inputs[i] << std::endl;
+		runBenchmark("Legacy", &legacyCall, inputs[i], iterations);
+		runBenchmark("View  ", &viewCall, inputs[i], iterations);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+#include <string>
+
+
+class OutputWriter
+// Writes straight into arma output char, no heap allocation
+//   output_size = max chars to write, output always gets null terminated (same as RVExtension outputSize - 1)
+//   Anything past output_size is dropped + truncated() returns true
+{
+	public:
+		OutputWriter(char *output, const int &output_size);
+
+		OutputWriter& append(const char *str);
+		OutputWriter& append(const char *str, std::size_t len);
+		OutputWriter& append(const boost::string_ref &str);
+		OutputWriter& append(const std::string &str);
+		OutputWriter& append(const int &value);
+		OutputWriter& append(const unsigned long long &value);
+
+		std::size_t length() const;
+		bool truncated() const;
+
+	private:
+		char *output;
+		std::size_t max_size;
+		std::size_t pos;
+		bool overflow;
+};
+
+
+namespace OutputParser
+{
+	// Same as std::string::find(c, pos) for views, returns boost::string_ref::npos if not found
+	std::size_t find(const boost::string_ref &str, const char c, const std::size_t pos);
+
+	// Parses Unique ID from view of input, no exceptions / allocation
+	bool parseInt(const boost::string_ref &str, int &value);
+	bool parseUInt64(const boost::string_ref &str, unsigned long long &value);
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "protocol_registry.h"
+
+#include <boost/functional/hash.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+
+namespace
+{
+	// Hash + Equal for looking up std::string keys with boost::string_ref (same hash as boost::hash<std::string>)
+	struct StringRefHash
+	{
+		std::size_t operator()(const boost::string_ref &str) const
+		{
+			return boost::hash_range(str.begin(), str.end());
+		}
+	};
+
+	struct StringRefEqual
+	{
+		bool operator()(const boost::string_ref &lhs, const std::string &rhs) const
+		{
+			return lhs == boost::string_ref(rhs);
+		}
+		bool operator()(const std::string &lhs, const boost::string_ref &rhs) const
+		{
+			return boost::string_ref(lhs) == rhs;
+		}
+	};
+}
+
+
+ProtocolRegistry::ProtocolRegistry()
+{
+	Protocols *empty_snapshot = new Protocols();
+	snapshots.push_back(empty_snapshot);
+	snapshot.store(empty_snapshot, boost::memory_order_release);
+}
+
+
+ProtocolRegistry::~ProtocolRegistry()
+{
+	for (std::vector<const Protocols*>::iterator it = snapshots.begin(); it != snapshots.end(); ++it)
+	{
+		delete *it;
+	}
+}
+
+
+const ProtocolEntry* ProtocolRegistry::find(const boost::string_ref &protocol_name) const
+{
+	const Protocols *protocols = snapshot.load(boost::memory_order_acquire);
+	Protocols::const_iterator itr = protocols->find(protocol_name, StringRefHash(), StringRefEqual());
+	if (itr == protocols->end())
+	{
+		return NULL;
+	}
+	return &(itr->second);
+}
+
+
+void ProtocolRegistry::add(const std::string &protocol_name, const ProtocolEntry &protocol_entry)
+{
+	boost::lock_guard<boost::mutex> lock(mutex_snapshots);
+	Protocols *new_snapshot = new Protocols(*snapshot.load(boost::memory_order_relaxed));
+	(*new_snapshot)[protocol_name] = protocol_entry;
+	snapshots.push_back(new_snapshot);
+	snapshot.store(new_snapshot, boost::memory_order_release);
+}
+
+
+void ProtocolRegistry::clear()
+{
+	boost::lock_guard<boost::mutex> lock(mutex_snapshots);
+	for (std::vector<const Protocols*>::iterator it = snapshots.begin(); it != snapshots.end(); ++it)
+	{
+		delete *it;
+	}
+	snapshots.clear();
+
+	Protocols *empty_snapshot = new Protocols();
+	snapshots.push_back(empty_snapshot);
+	snapshot.store(empty_snapshot, boost::memory_order_release);
+}
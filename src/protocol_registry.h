@@ -0,0 +1,77 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "write_behind.h"
+#include "protocols/abstract_protocol.h"
+
+
+struct Database;  // See ext.h
+
+
+struct ProtocolEntry
+// Loaded Protocol + Options set via 9:ADD
+{
+	boost::shared_ptr<AbstractProtocol> protocol;
+	std::size_t lane;  // Index of Worker Lane ASYNC calls are queued on
+	boost::shared_ptr<ConcurrencyLimiter> limiter;  // Only set if maxConcurrency option is used
+	bool coalesce;  // Identical ASYNC + SAVE calls in flight share one job + result
+	int timeout;    // Seconds from queuing ASYNC call until query is cancelled, 0 = No Timeout
+	boost::shared_ptr<Database> database;  // Database Protocol gets its Sessions from, default = first Database connected
+	bool read_your_writes;  // Reads skip Read Replica for Replica Lag seconds after a write to Database
+	boost::shared_ptr<WriteBehindQueue> write_behind;  // Only set if WriteBehind option is used, 1: calls are batched
+	bool native;  // Protocol runs SQL on the database C API instead of Poco Data, if it supports it for Database Type
+	boost::shared_ptr<GroupCommitQueue> group_commit;  // Only set if GroupCommit option is used, 2: calls share commits
+};
+
+
+class ProtocolRegistry
+// Loaded Protocols, readers use an immutable snapshot published via atomic pointer (no lock + no refcount)
+//   Adding a Protocol copies current snapshot, inserts + publishes new snapshot (copy-on-write)
+//   Old snapshots are kept until clear(), worker threads could still be reading them.
+//     Protocols are only added via 9:ADD during startup, so this is only a handful of small maps
+{
+	public:
+		typedef boost::unordered_map< std::string, ProtocolEntry > Protocols;
+
+		ProtocolRegistry();
+		~ProtocolRegistry();
+
+		const ProtocolEntry* find(const boost::string_ref &protocol_name) const;
+		void add(const std::string &protocol_name, const ProtocolEntry &protocol_entry);
+
+		// Only call once worker threads are stopped
+		void clear();
+
+	private:
+		boost::atomic<const Protocols*> snapshot;
+
+		std::vector<const Protocols*> snapshots;
+		boost::mutex mutex_snapshots;
+};
@@ -18,15 +18,26 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <boost/shared_ptr.hpp>
+
 #include <Poco/AutoPtr.h>
 #include <Poco/Data/Session.h>
 #include <Poco/Util/IniFileConfiguration.h>
 
 
+class SessionCache
+// Protocol data tied to one Database Session (i.e compiled Statements), destroyed before its Session is closed
+{
+	public:
+		virtual ~SessionCache() {}
+};
+
+
 class AbstractExt
 {
 	public:
 		virtual Poco::Data::Session getDBSession_mutexlock()=0;
+		virtual Poco::Data::Session getDBReadSession_mutexlock()=0;  // Read only SQL, can be served by a Read Replica
 		virtual std::string getAPIKey()=0;
 		
 		Poco::AutoPtr<Poco::Util::IniFileConfiguration> pConf;
@@ -35,4 +46,10 @@ class AbstractExt
 		virtual int getUniqueID_mutexlock()=0;
 		
 		virtual std::string getDBType()=0;
+		virtual bool useNativeEngine()=0;  // Protocol option Native=true, only valid during init() + callProtocol()
+		virtual bool useThreadSessions()=0;  // Database option Thread Sessions=true, only valid during init() + callProtocol()
+
+		// Cache slot of owner for session, only valid during callProtocol() on session
+		//   NULL unless session is a Thread Session (Database option), pooled Sessions can be closed by pool without notice
+		virtual boost::shared_ptr<SessionCache>* getSessionCache(Poco::Data::Session &session, const void *owner)=0;
 };
@@ -18,6 +18,11 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "abstract_protocol.h"
 
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <cctype>
+#include <vector>
+
 
 AbstractProtocol::AbstractProtocol()
 {
@@ -27,10 +32,79 @@ AbstractProtocol::~AbstractProtocol()
 {
 }
 
-void AbstractProtocol::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void AbstractProtocol::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
+{
+}
+
+bool AbstractProtocol::isReadOnlySQL(const std::string &sql)
+// SELECT ... FOR UPDATE / FOR SHARE / LOCK IN SHARE MODE / INTO + multiple statements stay on primary Database
+//   SQL is split into upper case words (any whitespace / punctuation between them), quoted strings + identifiers are skipped
 {
+	std::vector<std::string> words;
+	bool statement_ended = false;
+	for (std::size_t i = 0; i < sql.size(); ++i)
+	{
+		const char c = sql[i];
+		if ((c == '\'') || (c == '"') || (c == '`'))
+		{
+			if (statement_ended)
+			{
+				return false;
+			}
+			for (++i; (i < sql.size()) && (sql[i] != c); ++i)
+			{
+				if ((sql[i] == '\\') && (c != '`'))
+				{
+					++i;
+				}
+			}
+		}
+		else if (c == ';')
+		{
+			statement_ended = true;
+		}
+		else if (std::isalnum(static_cast<unsigned char>(c)) || (c == '_'))
+		{
+			if (statement_ended)
+			{
+				return false;
+			}
+			const std::size_t start = i;
+			while (((i + 1) < sql.size()) && (std::isalnum(static_cast<unsigned char>(sql[i + 1])) || (sql[i + 1] == '_')))
+			{
+				++i;
+			}
+			words.push_back(boost::algorithm::to_upper_copy(sql.substr(start, (i - start + 1))));
+		}
+		else if ((!std::isspace(static_cast<unsigned char>(c))) && statement_ended)
+		{
+			return false;
+		}
+	}
+
+	if (words.empty() || (words[0] != "SELECT"))
+	{
+		return false;
+	}
+	for (std::size_t i = 1; i < words.size(); ++i)
+	{
+		if (words[i] == "INTO")
+		{
+			return false;
+		}
+		if ((words[i] == "FOR") && ((i + 1) < words.size()) && ((words[i + 1] == "UPDATE") || (words[i + 1] == "SHARE")))
+		{
+			return false;
+		}
+		if ((words[i] == "LOCK") && ((i + 3) < words.size()) && (words[i + 1] == "IN") && (words[i + 2] == "SHARE") && (words[i + 3] == "MODE"))
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
+
 bool AbstractProtocol::init(AbstractExt *extension, const std::string init_str)
 {
 	// Use this function for any initialize, or if u need to read value from extdb-conf.ini i.e
@@ -35,8 +35,10 @@ class AbstractProtocol
 		virtual ~AbstractProtocol();
 
 		virtual bool init(AbstractExt *extension, const std::string init_str);
-		virtual void callProtocol(AbstractExt *extension, std::string input_str, std::string &result)=0;
+		virtual void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)=0;
 		
 	protected:
 		Poco::Logger *pLogger;
+
+		static bool isReadOnlySQL(const std::string &sql);  // Single SELECT, safe to run on a Read Replica
 };
@@ -290,7 +290,7 @@ Save		0-		2
 //setValue(table, uid, type, value)
 //getValue(table, uid, type, value)
 
-void DB_BASIC_V2::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_BASIC_V2::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 	try
 	{
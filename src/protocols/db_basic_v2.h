@@ -33,7 +33,7 @@ class DB_BASIC_V2: public AbstractProtocol
 {
 	public:
 		bool init(AbstractExt *extension, const std::string input_str);
-		void callProtocol(AbstractExt *extension, std::string input_str, std::string &result);
+		void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result);
 		
 	private:
 		bool isNumber(std::string &input_str);
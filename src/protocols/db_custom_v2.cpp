@@ -25,8 +25,10 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "Poco/Data/MySQL/Connector.h"
 #include "Poco/Data/MySQL/MySQLException.h"
+#include "Poco/Data/MySQL/SessionImpl.h"
 #include "Poco/Data/SQLite/Connector.h"
 #include "Poco/Data/SQLite/SQLiteException.h"
+#include "Poco/Data/SQLite/Utility.h"
 #include "Poco/Data/ODBC/Connector.h"
 #include "Poco/Data/ODBC/ODBCException.h"
 
@@ -43,10 +45,49 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <Poco/Util/IniFileConfiguration.h>
 
 
+#include <boost/thread/lock_guard.hpp>
+
+#include <mysql.h>
+#include <sqlite3.h>
+
 #include <cstdlib>
 #include <iostream>
 
 #include "../sanitize.h"
+#include "pooled_session.h"
+
+
+namespace
+{
+	void bindInput(const std::string &token, std::string &input)
+	// SQF String "abc" is bound without its quotes, SQF Bool as 1 / 0, everything else as is
+	{
+		if ((token.size() >= 2) && (token[0] == '"') && (token[token.size() - 1] == '"'))
+		{
+			input.clear();
+			for (std::size_t i = 1; i < (token.size() - 1); ++i)
+			{
+				input += token[i];
+				if ((token[i] == '"') && (token[i + 1] == '"'))
+				{
+					++i;  // SQF escapes " as ""
+				}
+			}
+		}
+		else if (token == "true")
+		{
+			input = "1";
+		}
+		else if (token == "false")
+		{
+			input = "0";
+		}
+		else
+		{
+			input = token;
+		}
+	}
+}
 
 
 bool DB_CUSTOM_V2::init(AbstractExt *extension, const std::string init_str)
@@ -54,17 +95,24 @@ bool DB_CUSTOM_V2::init(AbstractExt *extension, const std::string init_str)
 	pLogger = &Poco::Logger::get(("DB_CUSTOM_V2:" + init_str));
 	
 	bool status = false;
+	native = false;
 	
 	if (extension->getDBType() == std::string("MySQL"))
 	{
+		native = extension->useNativeEngine();
 		status = true;
 	}
 	else if (extension->getDBType() == std::string("ODBC"))
 	{
+		if (extension->useNativeEngine())
+		{
+			pLogger->warning("Native not supported for ODBC, using Poco Data");
+		}
 		status =  true;
 	}
 	else if (extension->getDBType() == std::string("SQLite"))
 	{
+		native = extension->useNativeEngine();
 		status =  true;
 	}
 	else
@@ -110,6 +158,8 @@ bool DB_CUSTOM_V2::init(AbstractExt *extension, const std::string init_str)
 			custom_protocol[call_name].number_of_inputs = template_ini->getInt(call_name + ".Number of Inputs", 0);
 			custom_protocol[call_name].sanitize_inputs = template_ini->getBool(call_name + ".Sanitize Input", true);
 			custom_protocol[call_name].sanitize_outputs = template_ini->getBool(call_name + ".Sanitize Output", true);
+			custom_protocol[call_name].prepared = template_ini->getBool(call_name + ".Prepared Statement", false);
+			custom_protocol[call_name].read_only = template_ini->getBool(call_name + ".Read Only", isReadOnlySQL(sql_str));
 			
 			std::list<Poco::DynamicAny> sql_list;
 			sql_list.push_back(Poco::DynamicAny(sql_str));
@@ -152,6 +202,41 @@ bool DB_CUSTOM_V2::init(AbstractExt *extension, const std::string init_str)
 				}
 			}
 			custom_protocol[call_name].sql = sql_list;
+
+			if (custom_protocol[call_name].prepared)
+			{
+				Template_Calls &template_call = custom_protocol[call_name];
+				for(std::list<Poco::DynamicAny>::iterator it_sql_list = sql_list.begin(); it_sql_list != sql_list.end(); ++it_sql_list)
+				{
+					if (it_sql_list->isString())
+					{
+						template_call.prepared_sql += it_sql_list->convert<std::string>();
+					}
+					else
+					{
+						template_call.prepared_sql += "?";
+						template_call.prepared_inputs.push_back(*it_sql_list);
+					}
+				}
+				// MySQL won't prepare a statement with a trailing ;
+				std::size_t sql_end = template_call.prepared_sql.find_last_not_of(" \t\r\n;");
+				template_call.prepared_sql.erase((sql_end == std::string::npos) ? 0 : (sql_end + 1));
+
+				if (!checkPreparedSQL(extension, call_name, template_call))
+				{
+					// Call keeps working as before, Inputs are spliced into SQL
+					pLogger->warning(call_name + ": Prepared Statement disabled, Inputs are spliced into SQL");
+					template_call.prepared = false;
+				}
+				else if ((extension->getDBType() == std::string("SQLite")) && (!extension->useThreadSessions()))
+				{
+					// Inputs are still bound, but nothing to cache Statement in (see getPreparedCall)
+					#ifdef TESTING
+						std::cout << "extDB: DB_CUSTOM_V2: " << call_name << ": SQLite without Thread Sessions, Prepared Statement is compiled every call" << std::endl;
+					#endif
+					pLogger->warning(call_name + ": SQLite without Thread Sessions, Prepared Statement is compiled every call");
+				}
+			}
 		}
 	} 
 	else 
@@ -161,75 +246,295 @@ bool DB_CUSTOM_V2::init(AbstractExt *extension, const std::string init_str)
 	return status;
 }
 
-void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_map<std::string, Template_Calls>::const_iterator itr, Poco::StringTokenizer &tokens, std::string &result)
+bool DB_CUSTOM_V2::checkPreparedSQL(AbstractExt *extension, const std::string &call_name, const Template_Calls &template_call)
+// Prepares template once at load, so SQL Errors show up when protocol is added instead of on first call
 {
-	std::string sql_str;
-	
-	for(std::list<Poco::DynamicAny>::const_iterator it_sql_list = (itr->second.sql).begin(); it_sql_list != (itr->second.sql).end(); ++it_sql_list) 
+	std::string error_str;
+	std::size_t params = template_call.prepared_inputs.size();
+	try
 	{
-		if (it_sql_list->isString())  // Check for Input Variable
+		Poco::Data::Session db_session = extension->getDBSession_mutexlock();
+		if (extension->getDBType() == std::string("MySQL"))
 		{
-			sql_str += it_sql_list->convert<std::string>();
+			Poco::Data::MySQL::SessionImpl *mysql_session = dynamic_cast<Poco::Data::MySQL::SessionImpl*>(PooledSessionAccess::physicalSession(db_session));
+			if (mysql_session != NULL)
+			{
+				MYSQL_STMT *stmt = mysql_stmt_init(mysql_session->handle());
+				if (stmt == NULL)
+				{
+					error_str = "Out of Memory";
+				}
+				else
+				{
+					if (mysql_stmt_prepare(stmt, template_call.prepared_sql.c_str(), template_call.prepared_sql.size()) != 0)
+					{
+						error_str = mysql_stmt_error(stmt);
+					}
+					else
+					{
+						params = mysql_stmt_param_count(stmt);
+					}
+					mysql_stmt_close(stmt);
+				}
+			}
 		}
-		else
+		else if (extension->getDBType() == std::string("SQLite"))
 		{
-			sql_str += tokens[*it_sql_list];
+			sqlite3 *db_handle = Poco::Data::SQLite::Utility::dbHandle(db_session);
+			sqlite3_stmt *stmt = NULL;
+			if (sqlite3_prepare_v2(db_handle, template_call.prepared_sql.c_str(), template_call.prepared_sql.size(), &stmt, NULL) != SQLITE_OK)
+			{
+				error_str = sqlite3_errmsg(db_handle);
+			}
+			else
+			{
+				params = sqlite3_bind_parameter_count(stmt);
+			}
+			sqlite3_finalize(stmt);
 		}
+		// ODBC -- No Driver independent way to prepare without executing, errors show up on first call
+	}
+	catch (Poco::Exception& e)
+	{
+		error_str = e.displayText();
 	}
 
-	try 
+	if (error_str.empty() && (params != template_call.prepared_inputs.size()))
 	{
-		Poco::Data::Session db_session = extension->getDBSession_mutexlock();
-		Poco::Data::Statement sql(db_session);
-		sql << sql_str;
-		sql.execute();
-		Poco::Data::RecordSet rs(sql);
-
-		result = "[1, [";
-		std::size_t cols = rs.columnCount();
-		if (cols >= 1)
+		error_str = "Inputs don't match placeholders, $INPUT_x inside quotes / multiple SQL statements need Prepared Statement = false";
+	}
+	if (!error_str.empty())
+	{
+		#ifdef TESTING
+			std::cout << "extDB: DB_CUSTOM_V2: Error: " << call_name << ": " << error_str << std::endl;
+		#endif
+		pLogger->warning("Error Preparing " + call_name + ": " + error_str);
+		pLogger->warning("SQL: " + template_call.prepared_sql);
+		return false;
+	}
+	return true;
+}
+
+
+boost::shared_ptr<DB_CUSTOM_V2::Prepared_Call> DB_CUSTOM_V2::getPreparedCall(AbstractExt *extension, Poco::Data::Session &db_session, const std::string &call_name, const Template_Calls &template_call)
+// Caller holds db_session, so only one thread uses a Prepared_Session at a time
+//   SQLite -- sqlite3_close fails while a statement is unfinalized, pool closing an idle Session would leak connection + file lock
+//     Cached in Thread Session (closed only after its caches are deleted), pooled Session: compiled per call + finalized before it goes back to pool
+{
+	if (NativeSQLite::handle(db_session) != NULL)
+	{
+		boost::shared_ptr<SessionCache> *session_cache = extension->getSessionCache(db_session, this);
+		if (session_cache == NULL)
+		{
+			return newPreparedCall(db_session, template_call);
+		}
+		if (!(*session_cache))
+		{
+			session_cache->reset(new Prepared_Calls());
+		}
+		boost::shared_ptr<Prepared_Call> &prepared_call = static_cast<Prepared_Calls*>(session_cache->get())->calls[call_name];
+		if (!prepared_call)
+		{
+			prepared_call = newPreparedCall(db_session, template_call);
+		}
+		return prepared_call;
+	}
+
+	Poco::Data::SessionImpl *session_impl = PooledSessionAccess::physicalSession(db_session);
+
+	boost::lock_guard<boost::mutex> lock(mutex_prepared_sessions);
+	boost::shared_ptr<Prepared_Session> &prepared_session = prepared_sessions[session_impl];
+	if (!prepared_session)
+	{
+		// New Database Session, drop Statements of Sessions the pool has closed meanwhile
+		for (boost::unordered_map<Poco::Data::SessionImpl*, boost::shared_ptr<Prepared_Session> >::iterator it = prepared_sessions.begin(); it != prepared_sessions.end();)
+		{
+			if (it->second && !(it->second->session.isConnected()))
+			{
+				it = prepared_sessions.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		prepared_session.reset(new Prepared_Session(Poco::Data::Session(Poco::AutoPtr<Poco::Data::SessionImpl>(session_impl, true))));
+	}
+
+	boost::shared_ptr<Prepared_Call> &prepared_call = prepared_session->calls[call_name];
+	if (!prepared_call)
+	{
+		prepared_call = newPreparedCall(prepared_session->session, template_call);
+	}
+	return prepared_call;
+}
+
+
+boost::shared_ptr<DB_CUSTOM_V2::Prepared_Call> DB_CUSTOM_V2::newPreparedCall(Poco::Data::Session &session, const Template_Calls &template_call)
+{
+	boost::shared_ptr<Prepared_Call> new_call(new Prepared_Call());
+	new_call->inputs.resize(template_call.prepared_inputs.size());  // Never resized after, bindings point into it
+	MYSQL *mysql = native ? NativeMySQL::handle(session) : NULL;
+	sqlite3 *sqlite_db = native ? NativeSQLite::handle(session) : NULL;
+	if (mysql != NULL)
+	{
+		new_call->mysql_statement.reset(new NativeMySQL::Statement(mysql, template_call.prepared_sql));
+	}
+	else if (sqlite_db != NULL)
+	{
+		new_call->sqlite_statement.reset(new NativeSQLite::Statement(sqlite_db, template_call.prepared_sql));
+	}
+	else
+	{
+		new_call->statement.reset(new Poco::Data::Statement(session));
+		*(new_call->statement) << template_call.prepared_sql;
+		for (std::vector<std::string>::iterator it = new_call->inputs.begin(); it != new_call->inputs.end(); ++it)
+		{
+			*(new_call->statement), Poco::Data::use(*it);
+		}
+	}
+	return new_call;
+}
+
+
+void DB_CUSTOM_V2::dropPreparedSession(AbstractExt *extension, Poco::Data::Session &db_session)
+// Statements are prepared again on next call, i.e after connection was lost
+{
+	boost::shared_ptr<SessionCache> *session_cache = extension->getSessionCache(db_session, this);
+	if (session_cache != NULL)
+	{
+		session_cache->reset();
+	}
+
+	Poco::Data::SessionImpl *session_impl = PooledSessionAccess::physicalSession(db_session);
+	boost::lock_guard<boost::mutex> lock(mutex_prepared_sessions);
+	prepared_sessions.erase(session_impl);
+}
+
+
+void DB_CUSTOM_V2::writeRecordSet(Poco::Data::RecordSet &rs, std::string &result)
+{
+	result = "[1, [";
+	std::size_t cols = rs.columnCount();
+	if (cols >= 1)
+	{
+		bool more = rs.moveFirst();
+		while (more)
 		{
-			bool more = rs.moveFirst();
-			while (more)
+			result += " [";
+			for (std::size_t col = 0; col < cols; ++col)
 			{
-				result += " [";
-				for (std::size_t col = 0; col < cols; ++col)
+				if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
 				{
-					if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
+					if (!rs[col].isEmpty())
 					{
-						if (!rs[col].isEmpty())
-						{
-							result += "\"" + (rs[col].convert<std::string>() + "\"");
-						}
-						else
-						{
-							result += ("\"\"");
-						}
+						result += "\"" + (rs[col].convert<std::string>() + "\"");
 					}
 					else
 					{
-						if (!rs[col].isEmpty())
-						{
-							result += rs[col].convert<std::string>();
-						}
+						result += ("\"\"");
 					}
-					if (col < (cols - 1))
+				}
+				else
+				{
+					if (!rs[col].isEmpty())
 					{
-						result += ", ";
+						result += rs[col].convert<std::string>();
 					}
 				}
-				more = rs.moveNext();
-				if (more)
+				if (col < (cols - 1))
 				{
-					result += "],";
+					result += ", ";
+				}
+			}
+			more = rs.moveNext();
+			if (more)
+			{
+				result += "],";
+			}
+			else
+			{
+				result += "]";
+			}
+		}
+	}
+	result += "]]";
+}
+
+
+void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_map<std::string, Template_Calls>::const_iterator itr, Poco::StringTokenizer &tokens, std::string &result)
+{
+	std::string sql_str;
+	boost::shared_ptr<Poco::Data::Session> db_session;
+
+	try 
+	{
+		if (itr->second.read_only)
+		{
+			db_session.reset(new Poco::Data::Session(extension->getDBReadSession_mutexlock()));
+		}
+		else
+		{
+			db_session.reset(new Poco::Data::Session(extension->getDBSession_mutexlock()));
+		}
+		if (itr->second.prepared)
+		{
+			sql_str = itr->second.prepared_sql;
+			boost::shared_ptr<Prepared_Call> prepared_call = getPreparedCall(extension, *db_session, itr->first, itr->second);
+			for (std::size_t i = 0; i < itr->second.prepared_inputs.size(); ++i)
+			{
+				bindInput(tokens[itr->second.prepared_inputs[i]], prepared_call->inputs[i]);
+			}
+			if (prepared_call->mysql_statement)
+			{
+				prepared_call->mysql_statement->execute(prepared_call->inputs, result);
+			}
+			else if (prepared_call->sqlite_statement)
+			{
+				prepared_call->sqlite_statement->execute(prepared_call->inputs, result);
+			}
+			else
+			{
+				prepared_call->statement->execute();
+				Poco::Data::RecordSet rs(*(prepared_call->statement));
+				writeRecordSet(rs, result);
+			}
+		}
+		else
+		{
+			for(std::list<Poco::DynamicAny>::const_iterator it_sql_list = (itr->second.sql).begin(); it_sql_list != (itr->second.sql).end(); ++it_sql_list) 
+			{
+				if (it_sql_list->isString())  // Check for Input Variable
+				{
+					sql_str += it_sql_list->convert<std::string>();
 				}
 				else
 				{
-					result += "]";
+					sql_str += tokens[*it_sql_list];
 				}
 			}
+
+			MYSQL *mysql = native ? NativeMySQL::handle(*db_session) : NULL;
+			sqlite3 *sqlite_db = native ? NativeSQLite::handle(*db_session) : NULL;
+			if (mysql != NULL)
+			{
+				NativeMySQL::query(mysql, sql_str, result);
+			}
+			else if (sqlite_db != NULL)
+			{
+				// Inputs are spliced into SQL, so Statement isn't worth caching
+				NativeSQLite::Statement statement(sqlite_db, sql_str);
+				statement.execute(std::vector<std::string>(), result);
+			}
+			else
+			{
+				Poco::Data::Statement sql(*db_session);
+				sql << sql_str;
+				sql.execute();
+				Poco::Data::RecordSet rs(sql);
+				writeRecordSet(rs, result);
+			}
 		}
-		result += "]]";
 		#ifdef TESTING
 			std::cout << "extDB: DB_CUSTOM_V2: DEBUG INFO: RESULT:" + result << std::endl;
 		#endif
@@ -245,6 +550,10 @@ void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_m
 		pLogger->critical("Input: " + sql_str);
 		pLogger->critical("Database Locked Exception: " + e.displayText());
 		result = "[0,\"Error DBLocked Exception\"]";
+		if (db_session && itr->second.prepared)
+		{
+			dropPreparedSession(extension, *db_session);
+		}
 	}
 	catch (Poco::Data::MySQL::ConnectionException& e)
 	{
@@ -254,6 +563,10 @@ void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_m
 		pLogger->critical("Input: " + sql_str);
 		pLogger->critical("Connection Exception: " + e.displayText());
 		result = "[0,\"Error Connection Exception\"]";
+		if (db_session && itr->second.prepared)
+		{
+			dropPreparedSession(extension, *db_session);
+		}
 	}
 	catch(Poco::Data::MySQL::StatementException& e)
 	{
@@ -263,6 +576,10 @@ void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_m
 		pLogger->critical("Input: " + sql_str);
 		pLogger->critical("Statement Exception: " + e.displayText());
 		result = "[0,\"Error Statement Exception\"]";
+		if (db_session && itr->second.prepared)
+		{
+			dropPreparedSession(extension, *db_session);
+		}
 	}
 	catch (Poco::Data::DataException& e)
     {
@@ -272,6 +589,10 @@ void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_m
 		pLogger->critical("Input: " + sql_str);
 		pLogger->critical("Data Exception: " + e.displayText());
         result = "[0,\"Error Data Exception\"]";
+		if (db_session && itr->second.prepared)
+		{
+			dropPreparedSession(extension, *db_session);
+		}
     }
     catch (Poco::Exception& e)
 	{
@@ -281,11 +602,15 @@ void DB_CUSTOM_V2::callCustomProtocol(AbstractExt *extension, boost::unordered_m
 		pLogger->critical("Input: " + sql_str);
 		pLogger->critical("Exception: " + e.displayText());
 		result = "[0,\"Error Exception\"]";
+		if (db_session && itr->second.prepared)
+		{
+			dropPreparedSession(extension, *db_session);
+		}
 	}
 }
 
 
-void DB_CUSTOM_V2::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_CUSTOM_V2::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 	Poco::StringTokenizer tokens(input_str, ":");
 	
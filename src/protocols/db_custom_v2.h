@@ -18,9 +18,14 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
+#include <Poco/Data/RecordSet.h>
+#include <Poco/Data/Session.h>
 #include <Poco/Data/SessionPool.h>
+#include <Poco/Data/Statement.h>
 #include <Poco/StringTokenizer.h>
 
 #include <Poco/DynamicAny.h>
@@ -30,24 +35,57 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "abstract_ext.h"
 #include "abstract_protocol.h"
+#include "native_mysql.h"
+#include "native_sqlite.h"
 
 
 class DB_CUSTOM_V2: public AbstractProtocol
 {
 	public:
 		bool init(AbstractExt *extension, const std::string init_str);
-		void callProtocol(AbstractExt *extension, std::string input_str, std::string &result);
+		void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result);
 		
 	private:
 		Poco::AutoPtr<Poco::Util::IniFileConfiguration> template_ini;
+		bool native;  // Protocol option Native=true + MySQL / SQLite, results are written via NativeMySQL / NativeSQLite
 		
 		struct Template_Calls {
 			std::list<Poco::DynamicAny> sql;
 			int number_of_inputs;
 			bool sanitize_inputs;
 			bool sanitize_outputs;
+			bool read_only;                    // Read Only = true / false, default = detected from SQL. Read only calls can use a Read Replica
+			bool prepared;                     // Prepared Statement = true, false (default) = Inputs spliced into SQL
+			std::string prepared_sql;          // $INPUT_x replaced with ?
+			std::vector<int> prepared_inputs;  // Input Number bound to each ?
 		};
 		boost::unordered_map<std::string, Template_Calls> custom_protocol;
 
+		// Prepared Statements -- compiled once per Database Session, reused for every call after
+		//   Keyed by the real Session behind the pooled Session, since each pool get() wraps it in a new SessionImpl
+		//   Except SQLite, Statements are only cached in Thread Sessions (Prepared_Calls) + compiled every call otherwise, see getPreparedCall
+		struct Prepared_Call {
+			boost::shared_ptr<Poco::Data::Statement> statement;
+			boost::shared_ptr<NativeMySQL::Statement> mysql_statement;    // Native MySQL, set instead of statement
+			boost::shared_ptr<NativeSQLite::Statement> sqlite_statement;  // Native SQLite, set instead of statement
+			std::vector<std::string> inputs;  // Bound by reference, values are replaced each call
+		};
+		struct Prepared_Session {
+			Prepared_Session(const Poco::Data::Session &session) : session(session) {}
+			Poco::Data::Session session;
+			boost::unordered_map<std::string, boost::shared_ptr<Prepared_Call> > calls;
+		};
+		struct Prepared_Calls : public SessionCache {  // SQLite Thread Session
+			boost::unordered_map<std::string, boost::shared_ptr<Prepared_Call> > calls;
+		};
+		boost::unordered_map<Poco::Data::SessionImpl*, boost::shared_ptr<Prepared_Session> > prepared_sessions;
+		boost::mutex mutex_prepared_sessions;
+
+		bool checkPreparedSQL(AbstractExt *extension, const std::string &call_name, const Template_Calls &template_call);
+		boost::shared_ptr<Prepared_Call> getPreparedCall(AbstractExt *extension, Poco::Data::Session &db_session, const std::string &call_name, const Template_Calls &template_call);
+		boost::shared_ptr<Prepared_Call> newPreparedCall(Poco::Data::Session &session, const Template_Calls &template_call);
+		void dropPreparedSession(AbstractExt *extension, Poco::Data::Session &db_session);
+
 		void callCustomProtocol(AbstractExt *extension, boost::unordered_map<std::string, Template_Calls>::const_iterator itr, Poco::StringTokenizer &tokens, std::string &result);
+		void writeRecordSet(Poco::Data::RecordSet &rs, std::string &result);
 };
@@ -31,7 +31,7 @@ class DB_PROCEDURE: public AbstractProtocol
 {
 	public:
 		bool init(AbstractExt *extension, const std::string init_str);
-		void callProtocol(AbstractExt *extension, std::string input_str, std::string &result);
+		void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result);
 
 		
 	private:
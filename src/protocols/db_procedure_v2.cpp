@@ -82,7 +82,7 @@ bool status = true;
 return status;
 }
 
-void DB_PROCEDURE_V2::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_PROCEDURE_V2::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 //  Unique ID
 //   |
@@ -62,7 +62,7 @@ bool DB_RAW::init(AbstractExt *extension, const std::string init_str)
 	}
 }
 
-void DB_RAW::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_RAW::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
     try
     {
@@ -62,7 +62,7 @@ bool DB_RAW_NO_EXTRA_QUOTES::init(AbstractExt *extension, const std::string init
 }
 
 
-void DB_RAW_NO_EXTRA_QUOTES::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_RAW_NO_EXTRA_QUOTES::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
     try
     {
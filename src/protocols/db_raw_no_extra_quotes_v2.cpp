@@ -62,7 +62,7 @@ bool DB_RAW_NO_EXTRA_QUOTES_V2::init(AbstractExt *extension, const std::string i
 }
 
 
-void DB_RAW_NO_EXTRA_QUOTES_V2::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_RAW_NO_EXTRA_QUOTES_V2::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
     try
     {
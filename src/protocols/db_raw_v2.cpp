@@ -35,21 +35,30 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <iostream>
 
+#include "native_mysql.h"
+
 
 bool DB_RAW_V2::init(AbstractExt *extension, const std::string init_str)
 {
 	pLogger = &Poco::Logger::get("DB_RAW_V2");
+	native = false;
 	
 	if (extension->getDBType() == std::string("MySQL"))
 	{
+		native = extension->useNativeEngine();
 		return true;
 	}
 	else if (extension->getDBType() == std::string("ODBC"))
 	{
+		if (extension->useNativeEngine())
+		{
+			pLogger->warning("Native not supported for ODBC, using Poco Data");
+		}
 		return true;
 	}
 	else if (extension->getDBType() == std::string("SQLite"))
 	{
+		native = extension->useNativeEngine();
 		return true;
 	}
 	else
@@ -63,7 +72,7 @@ bool DB_RAW_V2::init(AbstractExt *extension, const std::string init_str)
 	}
 }
 
-void DB_RAW_V2::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void DB_RAW_V2::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
     try
     {
@@ -73,57 +82,71 @@ void DB_RAW_V2::callProtocol(AbstractExt *extension, std::string input_str, std:
 		#ifdef DEBUG_LOGGING
 			pLogger->trace(" " + input_str);
 		#endif
-		Poco::Data::Session db_session = extension->getDBSession_mutexlock();
-		Poco::Data::Statement sql(db_session);
-		sql << input_str;
-		sql.execute();
-		Poco::Data::RecordSet rs(sql);
-
-		result = "[1, [";
-		std::size_t cols = rs.columnCount();
-		if (cols >= 1)
+		Poco::Data::Session db_session = isReadOnlySQL(input_str) ? extension->getDBReadSession_mutexlock() : extension->getDBSession_mutexlock();
+		MYSQL *mysql = native ? NativeMySQL::handle(db_session) : NULL;
+		if (mysql != NULL)
+		{
+			NativeMySQL::query(mysql, input_str, result);
+		}
+		else if (native && (NativeSQLite::handle(db_session) != NULL))
+		{
+			// Values are part of SQL, so Statement isn't worth caching. Finalized before db_session goes back to pool
+			NativeSQLite::Statement statement(NativeSQLite::handle(db_session), input_str);
+			statement.execute(std::vector<std::string>(), result);
+		}
+		else
 		{
-			bool more = rs.moveFirst();
-			while (more)
+			Poco::Data::Statement sql(db_session);
+			sql << input_str;
+			sql.execute();
+			Poco::Data::RecordSet rs(sql);
+
+			result = "[1, [";
+			std::size_t cols = rs.columnCount();
+			if (cols >= 1)
 			{
-				result += " [";
-				for (std::size_t col = 0; col < cols; ++col)
+				bool more = rs.moveFirst();
+				while (more)
 				{
-					if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
+					result += " [";
+					for (std::size_t col = 0; col < cols; ++col)
 					{
-						if (!rs[col].isEmpty())
+						if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
 						{
-							result += "\"" + (rs[col].convert<std::string>() + "\"");
+							if (!rs[col].isEmpty())
+							{
+								result += "\"" + (rs[col].convert<std::string>() + "\"");
+							}
+							else
+							{
+								result += ("\"\"");
+							}
 						}
 						else
 						{
-							result += ("\"\"");
+							if (!rs[col].isEmpty())
+							{
+								result += rs[col].convert<std::string>();
+							}
 						}
-					}
-					else
-					{
-						if (!rs[col].isEmpty())
+						if (col < (cols - 1))
 						{
-							result += rs[col].convert<std::string>();
+							result += ", ";
 						}
 					}
-					if (col < (cols - 1))
+					more = rs.moveNext();
+					if (more)
 					{
-						result += ", ";
+						result += "],";
+					}
+					else
+					{
+						result += "]";
 					}
-				}
-				more = rs.moveNext();
-				if (more)
-				{
-					result += "],";
-				}
-				else
-				{
-					result += "]";
 				}
 			}
+			result += "]]";
 		}
-		result += "]]";
 		#ifdef TESTING
 			std::cout << "extDB: DB_RAW_V2: DEBUG INFO: RESULT:" + result << std::endl;
 		#endif
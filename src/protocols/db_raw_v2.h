@@ -25,11 +25,15 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "abstract_ext.h"
 #include "abstract_protocol.h"
+#include "native_sqlite.h"
 
 
 class DB_RAW_V2: public AbstractProtocol
 {
 	public:
 		bool init(AbstractExt *extension, const std::string init_str);
-		void callProtocol(AbstractExt *extension, std::string input_str, std::string &result);
+		void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result);
+
+	private:
+		bool native;  // Protocol option Native=true + MySQL / SQLite, results are written via NativeMySQL / NativeSQLite
 };
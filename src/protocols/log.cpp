@@ -33,7 +33,7 @@ bool LOG::init(AbstractExt *extension, const std::string init_str)
 }
 
 
-void LOG::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void LOG::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 	//BOOST_LOG_SEV(extension->logger, boost::log::trivial::fatal) << input_str;
 	pLogger->information(input_str);
@@ -128,7 +128,7 @@ void MISC::getBEGUID(std::string &input_str, std::string &result)
 }
 
 
-void MISC::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void MISC::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 	// Protocol
 	const std::string sep_char(":");
@@ -20,7 +20,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "misc_log.h"
 
 
-void MISC_LOG::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+void MISC_LOG::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 {
 	//BOOST_LOG_SEV(extension->logger, boost::log::trivial::fatal) << input_str;
 	result = "[1]";
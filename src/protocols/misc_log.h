@@ -25,5 +25,5 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 class MISC_LOG: public AbstractProtocol
 {
 	public:
-		void callProtocol(AbstractExt *extension, std::string input_str, std::string &result);
+		void callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result);
 };
\ No newline at end of file
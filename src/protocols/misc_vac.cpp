@@ -232,7 +232,7 @@ From Frank https://gist.github.com/Fank/11127158
 	}
 
 
-	void MISC_VAC::callProtocol(AbstractExt *extension, std::string input_str, std::string &result)
+	void MISC_VAC::callProtocol(AbstractExt *extension, const std::string &input_str, std::string &result)
 	{
 		Poco::StringTokenizer t_arg(input_str, ":");
 		const int num_of_inputs = t_arg.count();
@@ -0,0 +1,464 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "native_mysql.h"
+
+#include "Poco/Data/MySQL/MySQLException.h"
+#include "Poco/Data/MySQL/SessionImpl.h"
+
+#include <cstring>
+
+#include "pooled_session.h"
+
+
+namespace
+{
+	void appendField(std::string &result, const char *field, const unsigned long &length, const bool &is_null, const bool &quoted)
+	// NULL String = "", NULL Number = nothing (same as RecordSet path)
+	{
+		if (quoted)
+		{
+			result += '"';
+			if (!is_null)
+			{
+				result.append(field, length);
+			}
+			result += '"';
+		}
+		else if (!is_null)
+		{
+			result.append(field, length);
+		}
+	}
+
+
+	struct QueryGuard
+	// Frees current result + reads and drops result sets still pending (CALL proc() / multi statement SQL)
+	//   Connection is out of sync until all of them are read, so this also runs if we throw half way
+	{
+		QueryGuard(MYSQL *mysql) : mysql(mysql), mysql_result(NULL) {}
+		~QueryGuard()
+		{
+			if (mysql_result != NULL)
+			{
+				mysql_free_result(mysql_result);
+			}
+			while (mysql_next_result(mysql) == 0)
+			{
+				MYSQL_RES *next_result = mysql_use_result(mysql);
+				if (next_result != NULL)
+				{
+					mysql_free_result(next_result);
+				}
+			}
+		}
+
+		MYSQL *mysql;
+		MYSQL_RES *mysql_result;
+	};
+}
+
+
+MYSQL* NativeMySQL::handle(Poco::Data::Session &session)
+{
+	Poco::Data::MySQL::SessionImpl *mysql_session = dynamic_cast<Poco::Data::MySQL::SessionImpl*>(PooledSessionAccess::physicalSession(session));
+	if (mysql_session == NULL)
+	{
+		return NULL;
+	}
+	return mysql_session->handle();
+}
+
+
+bool NativeMySQL::isQuoted(const MYSQL_FIELD &field)
+{
+	switch (field.type)
+	{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		case MYSQL_TYPE_YEAR:
+		case MYSQL_TYPE_NULL:
+			return false;
+		default:
+			return true;
+	}
+}
+
+
+void NativeMySQL::query(MYSQL *mysql, const std::string &sql, std::string &result)
+{
+	if (mysql_real_query(mysql, sql.c_str(), sql.size()) != 0)
+	{
+		throw Poco::Data::MySQL::StatementException(std::string(mysql_error(mysql)));
+	}
+
+	result = "[1, [";
+	QueryGuard query_guard(mysql);
+	query_guard.mysql_result = mysql_use_result(mysql);
+	if (query_guard.mysql_result == NULL)
+	{
+		if (mysql_field_count(mysql) != 0)
+		{
+			throw Poco::Data::MySQL::StatementException(std::string(mysql_error(mysql)));
+		}
+		// No Result Set i.e INSERT / UPDATE
+	}
+	else
+	{
+		const unsigned int cols = mysql_num_fields(query_guard.mysql_result);
+		const MYSQL_FIELD *fields = mysql_fetch_fields(query_guard.mysql_result);
+		std::vector<bool> quoted(cols);
+		for (unsigned int col = 0; col < cols; ++col)
+		{
+			quoted[col] = isQuoted(fields[col]);
+		}
+
+		bool first_row = true;
+		MYSQL_ROW row;
+		while ((row = mysql_fetch_row(query_guard.mysql_result)) != NULL)
+		{
+			const unsigned long *lengths = mysql_fetch_lengths(query_guard.mysql_result);
+			result += first_row ? " [" : ", [";
+			first_row = false;
+			for (unsigned int col = 0; col < cols; ++col)
+			{
+				appendField(result, row[col], lengths[col], (row[col] == NULL), quoted[col]);
+				if (col < (cols - 1))
+				{
+					result += ", ";
+				}
+			}
+			result += "]";
+		}
+		if (mysql_errno(mysql) != 0)
+		{
+			// Connection lost while streaming rows
+			throw Poco::Data::MySQL::StatementException(std::string(mysql_error(mysql)));
+		}
+	}
+	result += "]]";
+}
+
+
+NativeMySQL::Statement::Statement(MYSQL *mysql, const std::string &sql) : stmt(mysql_stmt_init(mysql))
+{
+	if (stmt == NULL)
+	{
+		throw Poco::Data::MySQL::StatementException(std::string(mysql_error(mysql)));
+	}
+	if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0)
+	{
+		const std::string error_str = mysql_stmt_error(stmt);
+		mysql_stmt_close(stmt);
+		throw Poco::Data::MySQL::StatementException(error_str);
+	}
+
+	const unsigned long params = mysql_stmt_param_count(stmt);
+	param_binds.resize(params);
+	param_lengths.resize(params);
+	if (params > 0)
+	{
+		std::memset(&param_binds[0], 0, sizeof(MYSQL_BIND) * params);
+	}
+	for (unsigned long i = 0; i < params; ++i)
+	{
+		param_binds[i].buffer_type = MYSQL_TYPE_STRING;
+		param_binds[i].length = &param_lengths[i];
+	}
+
+	MYSQL_RES *metadata = mysql_stmt_result_metadata(stmt);
+	if (metadata != NULL)
+	{
+		const unsigned int cols = mysql_num_fields(metadata);
+		const MYSQL_FIELD *fields = mysql_fetch_fields(metadata);
+		columns.resize(cols);
+		column_binds.resize(cols);
+		std::memset(&column_binds[0], 0, sizeof(MYSQL_BIND) * cols);
+		for (unsigned int col = 0; col < cols; ++col)
+		{
+			Column &column = columns[col];
+			column.quoted = isQuoted(fields[col]);
+			column.buffer.resize(256);  // Grows on first longer field
+
+			MYSQL_BIND &column_bind = column_binds[col];
+			column_bind.buffer_type = MYSQL_TYPE_STRING;
+			column_bind.buffer = &column.buffer[0];
+			column_bind.buffer_length = column.buffer.size();
+			column_bind.length = &column.length;
+			column_bind.is_null = &column.is_null;
+			column_bind.error = &column.error;
+		}
+		mysql_free_result(metadata);
+	}
+}
+
+
+NativeMySQL::Statement::~Statement()
+{
+	mysql_stmt_close(stmt);
+}
+
+
+void NativeMySQL::Statement::throwError()
+{
+	const std::string error_str = mysql_stmt_error(stmt);
+	discardResults();
+	throw Poco::Data::MySQL::StatementException(error_str);
+}
+
+
+void NativeMySQL::Statement::discardResults()
+// Reads + drops rest of result + result sets still pending (CALL proc()), so connection is usable again
+{
+	mysql_stmt_free_result(stmt);
+	while (mysql_stmt_next_result(stmt) == 0)
+	{
+		mysql_stmt_free_result(stmt);
+	}
+}
+
+
+void NativeMySQL::Statement::execute(const std::vector<std::string> &inputs, std::string &result)
+{
+	for (std::size_t i = 0; i < param_binds.size(); ++i)
+	{
+		param_binds[i].buffer = const_cast<char*>(inputs[i].data());
+		param_binds[i].buffer_length = inputs[i].size();
+		param_lengths[i] = inputs[i].size();
+	}
+	if ((!param_binds.empty()) && (mysql_stmt_bind_param(stmt, &param_binds[0]) != 0))
+	{
+		throwError();
+	}
+	if (mysql_stmt_execute(stmt) != 0)
+	{
+		throwError();
+	}
+
+	result = "[1, [";
+	if (!columns.empty())
+	{
+		if (mysql_stmt_bind_result(stmt, &column_binds[0]) != 0)
+		{
+			throwError();
+		}
+
+		bool first_row = true;
+		while (true)
+		{
+			const int status = mysql_stmt_fetch(stmt);
+			if (status == MYSQL_NO_DATA)
+			{
+				break;
+			}
+			else if (status == 1)
+			{
+				throwError();
+			}
+			else if (status == MYSQL_DATA_TRUNCATED)
+			{
+				// Field longer than its buffer, grow buffer + fetch field again
+				bool rebind = false;
+				for (std::size_t col = 0; col < columns.size(); ++col)
+				{
+					Column &column = columns[col];
+					if (column.error && (column.length > column.buffer.size()))
+					{
+						column.buffer.resize(column.length);
+						column_binds[col].buffer = &column.buffer[0];
+						column_binds[col].buffer_length = column.buffer.size();
+						if (mysql_stmt_fetch_column(stmt, &column_binds[col], col, 0) != 0)
+						{
+							throwError();
+						}
+						rebind = true;
+					}
+				}
+				if (rebind && (mysql_stmt_bind_result(stmt, &column_binds[0]) != 0))
+				{
+					throwError();
+				}
+			}
+
+			result += first_row ? " [" : ", [";
+			first_row = false;
+			for (std::size_t col = 0; col < columns.size(); ++col)
+			{
+				const Column &column = columns[col];
+				appendField(result, &column.buffer[0], column.length, column.is_null, column.quoted);
+				if (col < (columns.size() - 1))
+				{
+					result += ", ";
+				}
+			}
+			result += "]";
+		}
+	}
+	discardResults();
+	result += "]]";
+}
+
+
+#ifdef TEST_NATIVE_MYSQL_APP
+
+#include <Poco/Data/MetaColumn.h>
+#include <Poco/Data/RecordSet.h>
+#include <Poco/Data/Statement.h>
+#include "Poco/Data/MySQL/Connector.h"
+
+#include <boost/chrono.hpp>
+
+#include <iomanip>
+#include <iostream>
+
+// Compares RecordSet path of DB_RAW_V2 / DB_CUSTOM_V2 versus NativeMySQL query + prepared Statement on a 100k row table
+//   Usage: extDB-native-mysql "host=localhost;port=3306;user=extdb;password=...;db=extdb_bench"
+namespace
+{
+	typedef boost::chrono::high_resolution_clock Clock;
+
+	void recordSetQuery(Poco::Data::Session &session, const std::string &sql, std::string &result)
+	// Same loop as DB_RAW_V2::callProtocol before Native option
+	{
+		Poco::Data::Statement statement(session);
+		statement << sql;
+		statement.execute();
+		Poco::Data::RecordSet rs(statement);
+
+		result = "[1, [";
+		std::size_t cols = rs.columnCount();
+		if (cols >= 1)
+		{
+			bool more = rs.moveFirst();
+			while (more)
+			{
+				result += " [";
+				for (std::size_t col = 0; col < cols; ++col)
+				{
+					if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
+					{
+						if (!rs[col].isEmpty())
+						{
+							result += "\"" + (rs[col].convert<std::string>() + "\"");
+						}
+						else
+						{
+							result += ("\"\"");
+						}
+					}
+					else
+					{
+						if (!rs[col].isEmpty())
+						{
+							result += rs[col].convert<std::string>();
+						}
+					}
+					if (col < (cols - 1))
+					{
+						result += ", ";
+					}
+				}
+				more = rs.moveNext();
+				if (more)
+				{
+					result += "],";
+				}
+				else
+				{
+					result += "]";
+				}
+			}
+		}
+		result += "]]";
+	}
+
+	void report(const std::string &name, const int &runs, const std::size_t &result_size, const Clock::duration &elapsed)
+	{
+		const double ms = boost::chrono::duration_cast< boost::chrono::duration<double, boost::milli> >(elapsed).count() / runs;
+		std::cout << std::setw(20) << name << "  ms/query: " << std::setw(10) << ms;
+		std::cout << "  rows/sec: " << std::setw(12) << static_cast<long long>(100000 / (ms / 1000));
+		std::cout << "  result bytes: " << result_size << std::endl;
+	}
+}
+
+
+int main(int nNumberofArgs, char* pszArgs[])
+{
+	if (nNumberofArgs < 2)
+	{
+		std::cout << "Usage: " << pszArgs[0] << " MYSQL_CONNECTION_STRING" << std::endl;
+		return 1;
+	}
+	Poco::Data::MySQL::Connector::registerConnector();
+	Poco::Data::Session session("MySQL", pszArgs[1]);
+
+	// 100k rows, mix of number + string columns similar to a Vehicles table
+	session << "CREATE TABLE IF NOT EXISTS NativeBenchmark (id INT PRIMARY KEY, class VARCHAR(64), damage DOUBLE, fuel DOUBLE, inventory TEXT)", Poco::Data::now;
+	int rows = 0;
+	session << "SELECT COUNT(*) FROM NativeBenchmark", Poco::Data::into(rows), Poco::Data::now;
+	if (rows != 100000)
+	{
+		session << "DELETE FROM NativeBenchmark", Poco::Data::now;
+		session.begin();
+		for (int i = 0; i < 100000; ++i)
+		{
+			session << "INSERT INTO NativeBenchmark VALUES (?, 'B_Heli_Light_01_F', 0.25, 0.75, '[[\"arifle_MX_F\"],[30,30]]')", Poco::Data::use(i), Poco::Data::now;
+		}
+		session.commit();
+	}
+
+	const std::string sql = "SELECT id, class, damage, fuel, inventory FROM NativeBenchmark";
+	const int runs = 10;
+	std::string result;
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < runs; ++i)
+	{
+		recordSetQuery(session, sql, result);
+	}
+	report("RecordSet", runs, result.size(), Clock::now() - start);
+
+	MYSQL *mysql = NativeMySQL::handle(session);
+	start = Clock::now();
+	for (int i = 0; i < runs; ++i)
+	{
+		NativeMySQL::query(mysql, sql, result);
+	}
+	report("Native Query", runs, result.size(), Clock::now() - start);
+
+	NativeMySQL::Statement statement(mysql, sql);
+	const std::vector<std::string> inputs;
+	start = Clock::now();
+	for (int i = 0; i < runs; ++i)
+	{
+		statement.execute(inputs, result);
+	}
+	report("Native Statement", runs, result.size(), Clock::now() - start);
+
+	Poco::Data::MySQL::Connector::unregisterConnector();
+	return 0;
+}
+#endif
@@ -0,0 +1,78 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <Poco/Data/Session.h>
+
+#include <mysql.h>
+
+#include <string>
+#include <vector>
+
+
+class NativeMySQL
+// Runs SQL straight on the MySQL C API handle behind a Poco Session (Protocol option Native=true)
+//   Rows are streamed from server (mysql_use_result / mysql_stmt_fetch without store) + each field is appended to SQF result as it arrives
+//   Skips RecordSet copy of whole result + a Poco::DynamicAny per cell, output format is same as RecordSet path
+//   Errors are thrown as Poco::Data::MySQL::StatementException, so protocols keep their catch blocks
+{
+	public:
+		static MYSQL* handle(Poco::Data::Session &session);  // NULL if Session isn't MySQL
+		static void query(MYSQL *mysql, const std::string &sql, std::string &result);  // Text protocol, for SQL with values already in it
+
+		class Statement : private boost::noncopyable
+		// Prepared Statement (binary protocol), only use it from one thread at a time i.e while holding its Session
+		//   Inputs are bound as strings, fields are fetched as strings into buffers that grow on truncation
+		{
+			public:
+				Statement(MYSQL *mysql, const std::string &sql);
+				~Statement();
+
+				void execute(const std::vector<std::string> &inputs, std::string &result);
+
+			private:
+				// MYSQL_BIND is_null / error, my_bool was replaced by bool in MySQL 8.0.1 client lib (MariaDB still uses my_bool)
+				#if (MYSQL_VERSION_ID >= 80001) && !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_PACKAGE_VERSION_ID)
+					typedef bool NullFlag;
+				#else
+					typedef my_bool NullFlag;
+				#endif
+				struct Column {
+					std::vector<char> buffer;
+					unsigned long length;
+					NullFlag is_null;
+					NullFlag error;
+					bool quoted;
+				};
+
+				MYSQL_STMT *stmt;
+				std::vector<MYSQL_BIND> param_binds;
+				std::vector<unsigned long> param_lengths;
+				std::vector<MYSQL_BIND> column_binds;
+				std::vector<Column> columns;  // Never resized after constructor, column_binds point into it
+
+				void throwError();
+				void discardResults();
+		};
+
+		static bool isQuoted(const MYSQL_FIELD &field);  // Numbers are unquoted in SQF result, same as RecordSet path
+};
@@ -0,0 +1,329 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "native_sqlite.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include "Poco/Data/SQLite/SessionImpl.h"
+#include "Poco/Data/SQLite/SQLiteException.h"
+#include "Poco/Data/SQLite/Utility.h"
+
+#include "pooled_session.h"
+
+
+sqlite3* NativeSQLite::handle(Poco::Data::Session &session)
+{
+	if (dynamic_cast<Poco::Data::SQLite::SessionImpl*>(PooledSessionAccess::physicalSession(session)) == NULL)
+	{
+		return NULL;
+	}
+	return Poco::Data::SQLite::Utility::dbHandle(session);
+}
+
+
+NativeSQLite::Statement::Statement(sqlite3 *db, const std::string &sql) : db(db), stmt(NULL)
+{
+	const char *tail = NULL;
+	const int status = sqlite3_prepare_v2(db, sql.c_str(), sql.size(), &stmt, &tail);
+	if (status != SQLITE_OK)
+	{
+		throwError(status);
+	}
+	if (stmt == NULL)
+	{
+		throw Poco::Data::SQLite::SQLiteException("Native: No SQL Statement");
+	}
+	if ((tail != NULL) && (std::string(tail).find_first_not_of(" \t\r\n;") != std::string::npos))
+	{
+		sqlite3_finalize(stmt);
+		throw Poco::Data::SQLite::SQLiteException("Native: Only one SQL Statement per call is supported");
+	}
+
+	// Text affinity rules from SQLite docs, column without declared type (i.e expression) is not text
+	const int cols = sqlite3_column_count(stmt);
+	text_columns.resize(cols);
+	for (int col = 0; col < cols; ++col)
+	{
+		const char *decltype_str = sqlite3_column_decltype(stmt, col);
+		if (decltype_str != NULL)
+		{
+			const std::string column_type = boost::algorithm::to_upper_copy(std::string(decltype_str));
+			text_columns[col] = (column_type.find("INT") == std::string::npos) &&
+								((column_type.find("CHAR") != std::string::npos) || (column_type.find("CLOB") != std::string::npos) || (column_type.find("TEXT") != std::string::npos));
+		}
+	}
+}
+
+
+NativeSQLite::Statement::~Statement()
+{
+	sqlite3_finalize(stmt);
+}
+
+
+void NativeSQLite::Statement::throwError(const int &status)
+{
+	const std::string error_str = sqlite3_errmsg(db);
+	if (stmt != NULL)
+	{
+		sqlite3_reset(stmt);
+	}
+	if ((status == SQLITE_BUSY) || (status == SQLITE_LOCKED))
+	{
+		throw Poco::Data::SQLite::DBLockedException(error_str);
+	}
+	throw Poco::Data::SQLite::SQLiteException(error_str);
+}
+
+
+void NativeSQLite::Statement::execute(const std::vector<std::string> &inputs, std::string &result)
+{
+	sqlite3_reset(stmt);  // In case last call threw while building result
+	const int params = sqlite3_bind_parameter_count(stmt);
+	for (int i = 0; (i < params) && (static_cast<std::size_t>(i) < inputs.size()); ++i)
+	{
+		// Inputs outlive the step loop, so SQLite doesn't need its own copy
+		const int status = sqlite3_bind_text(stmt, (i + 1), inputs[i].data(), inputs[i].size(), SQLITE_STATIC);
+		if (status != SQLITE_OK)
+		{
+			throwError(status);
+		}
+	}
+
+	result = "[1, [";
+	const int cols = sqlite3_column_count(stmt);
+	bool first_row = true;
+	int status;
+	while ((status = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		result += first_row ? " [" : ", [";
+		first_row = false;
+		for (int col = 0; col < cols; ++col)
+		{
+			switch (sqlite3_column_type(stmt, col))
+			{
+				case SQLITE_INTEGER:
+				case SQLITE_FLOAT:
+					// SQLite formats the number, same text as SELECT in sqlite3 shell
+					result.append(reinterpret_cast<const char*>(sqlite3_column_text(stmt, col)), sqlite3_column_bytes(stmt, col));
+					break;
+				case SQLITE_TEXT:
+					result += '"';
+					result.append(reinterpret_cast<const char*>(sqlite3_column_text(stmt, col)), sqlite3_column_bytes(stmt, col));
+					result += '"';
+					break;
+				case SQLITE_BLOB:
+					result += '"';
+					result.append(static_cast<const char*>(sqlite3_column_blob(stmt, col)), sqlite3_column_bytes(stmt, col));
+					result += '"';
+					break;
+				default:  // SQLITE_NULL
+					if (text_columns[col])
+					{
+						result += "\"\"";
+					}
+					break;
+			}
+			if (col < (cols - 1))
+			{
+				result += ", ";
+			}
+		}
+		result += "]";
+	}
+	if (status != SQLITE_DONE)
+	{
+		throwError(status);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	result += "]]";
+}
+
+
+#ifdef TEST_NATIVE_SQLITE_APP
+
+#include <Poco/Data/MetaColumn.h>
+#include <Poco/Data/RecordSet.h>
+#include <Poco/Data/Statement.h>
+#include <Poco/NumberFormatter.h>
+#include "Poco/Data/SQLite/Connector.h"
+
+#include <boost/chrono.hpp>
+
+#include <iomanip>
+#include <iostream>
+
+// Compares RecordSet path of DB_RAW_V2 / DB_CUSTOM_V2 versus NativeSQLite Statement on a 100k row table
+//   Usage: extDB-native-sqlite [DATABASE_FILE], default native-benchmark.db
+namespace
+{
+	typedef boost::chrono::high_resolution_clock Clock;
+
+	void recordSetQuery(Poco::Data::Session &session, const std::string &sql, std::string &result)
+	// Same loop as DB_RAW_V2::callProtocol before Native option
+	{
+		Poco::Data::Statement statement(session);
+		statement << sql;
+		statement.execute();
+		Poco::Data::RecordSet rs(statement);
+
+		result = "[1, [";
+		std::size_t cols = rs.columnCount();
+		if (cols >= 1)
+		{
+			bool more = rs.moveFirst();
+			while (more)
+			{
+				result += " [";
+				for (std::size_t col = 0; col < cols; ++col)
+				{
+					if (rs.columnType(col) == Poco::Data::MetaColumn::FDT_STRING)
+					{
+						if (!rs[col].isEmpty())
+						{
+							result += "\"" + (rs[col].convert<std::string>() + "\"");
+						}
+						else
+						{
+							result += ("\"\"");
+						}
+					}
+					else
+					{
+						if (!rs[col].isEmpty())
+						{
+							result += rs[col].convert<std::string>();
+						}
+					}
+					if (col < (cols - 1))
+					{
+						result += ", ";
+					}
+				}
+				more = rs.moveNext();
+				if (more)
+				{
+					result += "],";
+				}
+				else
+				{
+					result += "]";
+				}
+			}
+		}
+		result += "]]";
+	}
+
+	void report(const std::string &name, const int &runs, const std::size_t &result_size, const Clock::duration &elapsed)
+	{
+		const double ms = boost::chrono::duration_cast< boost::chrono::duration<double, boost::milli> >(elapsed).count() / runs;
+		std::cout << std::setw(20) << name << "  ms/query: " << std::setw(10) << ms;
+		std::cout << "  rows/sec: " << std::setw(12) << static_cast<long long>(100000 / (ms / 1000));
+		std::cout << "  result bytes: " << result_size << std::endl;
+	}
+}
+
+
+int main(int nNumberofArgs, char* pszArgs[])
+{
+	Poco::Data::SQLite::Connector::registerConnector();
+	Poco::Data::Session session("SQLite", (nNumberofArgs >= 2) ? pszArgs[1] : "native-benchmark.db");
+
+	// 100k rows, mix of number + string columns similar to a Vehicles table
+	session << "CREATE TABLE IF NOT EXISTS NativeBenchmark (id INTEGER PRIMARY KEY, class VARCHAR(64), damage REAL, fuel REAL, inventory TEXT)", Poco::Data::now;
+	int rows = 0;
+	session << "SELECT COUNT(*) FROM NativeBenchmark", Poco::Data::into(rows), Poco::Data::now;
+	if (rows != 100000)
+	{
+		session << "DELETE FROM NativeBenchmark", Poco::Data::now;
+		session.begin();
+		for (int i = 0; i < 100000; ++i)
+		{
+			session << "INSERT INTO NativeBenchmark VALUES (?, 'B_Heli_Light_01_F', 0.25, 0.75, '[[\"arifle_MX_F\"],[30,30]]')", Poco::Data::use(i), Poco::Data::now;
+		}
+		session.commit();
+	}
+
+	const std::string sql = "SELECT id, class, damage, fuel, inventory FROM NativeBenchmark";
+	const int runs = 10;
+	std::string result;
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < runs; ++i)
+	{
+		recordSetQuery(session, sql, result);
+	}
+	report("RecordSet", runs, result.size(), Clock::now() - start);
+
+	// Statement per call, same as DB_RAW_V2 + DB_CUSTOM_V2 on a pooled Session
+	const std::vector<std::string> inputs;
+	start = Clock::now();
+	for (int i = 0; i < runs; ++i)
+	{
+		NativeSQLite::Statement statement(NativeSQLite::handle(session), sql);
+		statement.execute(inputs, result);
+	}
+	report("Native Statement", runs, result.size(), Clock::now() - start);
+
+	// Short lookups, mostly sqlite3_prepare cost (all 100k lookups are reported as one query)
+	start = Clock::now();
+	for (int i = 0; i < 100000; ++i)
+	{
+		recordSetQuery(session, "SELECT class, damage FROM NativeBenchmark WHERE id = " + Poco::NumberFormatter::format(i), result);
+	}
+	report("RecordSet Lookup", 1, result.size(), Clock::now() - start);
+
+	// DB_RAW_V2, values spliced into SQL + Statement per call
+	start = Clock::now();
+	for (int i = 0; i < 100000; ++i)
+	{
+		NativeSQLite::Statement lookup(NativeSQLite::handle(session), "SELECT class, damage FROM NativeBenchmark WHERE id = " + Poco::NumberFormatter::format(i));
+		lookup.execute(inputs, result);
+	}
+	report("Native Lookup", 1, result.size(), Clock::now() - start);
+
+	// DB_CUSTOM_V2 Prepared Statement on a pooled Session, bound input + Statement per call
+	std::vector<std::string> lookup_inputs(1);
+	start = Clock::now();
+	for (int i = 0; i < 100000; ++i)
+	{
+		NativeSQLite::Statement lookup(NativeSQLite::handle(session), "SELECT class, damage FROM NativeBenchmark WHERE id = ?");
+		lookup_inputs[0] = Poco::NumberFormatter::format(i);
+		lookup.execute(lookup_inputs, result);
+	}
+	report("Native Bound Lookup", 1, result.size(), Clock::now() - start);
+
+	// DB_CUSTOM_V2 Prepared Statement on a Thread Session, Statement is cached
+	{
+		NativeSQLite::Statement lookup(NativeSQLite::handle(session), "SELECT class, damage FROM NativeBenchmark WHERE id = ?");
+		start = Clock::now();
+		for (int i = 0; i < 100000; ++i)
+		{
+			lookup_inputs[0] = Poco::NumberFormatter::format(i);
+			lookup.execute(lookup_inputs, result);
+		}
+		report("Native Cached Lookup", 1, result.size(), Clock::now() - start);
+	}
+
+	Poco::Data::SQLite::Connector::unregisterConnector();
+	return 0;
+}
+#endif
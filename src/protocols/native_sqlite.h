@@ -0,0 +1,57 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <Poco/Data/Session.h>
+
+#include <sqlite3.h>
+
+#include <string>
+#include <vector>
+
+
+class NativeSQLite
+// Runs SQL straight on the sqlite3 handle behind a Poco Session (Protocol option Native=true)
+//   Columns are written into SQF result with sqlite3_column_* while stepping rows, no RecordSet / Poco::DynamicAny per cell
+//   Output format is same as RecordSet path, errors are thrown as Poco SQLite exceptions so protocols keep their catch blocks
+{
+	public:
+		static sqlite3* handle(Poco::Data::Session &session);  // NULL if Session isn't SQLite
+
+		class Statement : private boost::noncopyable
+		// Reset after each call, only use it from one thread at a time i.e while holding its Session
+		//   Destroy it before its Session goes back to pool, sqlite3_close fails (connection + file lock leak) while a statement is unfinalized
+		{
+			public:
+				Statement(sqlite3 *db, const std::string &sql);
+				~Statement();
+
+				void execute(const std::vector<std::string> &inputs, std::string &result);  // Inputs are bound as text
+
+			private:
+				sqlite3 *db;
+				sqlite3_stmt *stmt;
+				std::vector<bool> text_columns;  // Declared as text, NULL is returned as "" (same as RecordSet path)
+
+				void throwError(const int &status);
+		};
+};
@@ -0,0 +1,41 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#pragma once
+
+#include <Poco/Data/PooledSessionImpl.h>
+#include <Poco/Data/Session.h>
+
+
+class PooledSessionAccess : public Poco::Data::PooledSessionImpl
+// PooledSessionImpl only gives the real SessionImpl to subclasses
+//   Each pool get() wraps the real SessionImpl in a new PooledSessionImpl, so caches per connection are keyed on the real one
+{
+	public:
+		static Poco::Data::SessionImpl* physicalSession(Poco::Data::Session &session)
+		{
+			Poco::Data::SessionImpl *session_impl = session.impl();
+			Poco::Data::PooledSessionImpl *pooled_session_impl = dynamic_cast<Poco::Data::PooledSessionImpl*>(session_impl);
+			if (pooled_session_impl != NULL)
+			{
+				return (pooled_session_impl->*(&PooledSessionAccess::access))();
+			}
+			return session_impl;
+		}
+};
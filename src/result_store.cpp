@@ -0,0 +1,528 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "result_store.h"
+
+#include <boost/bind.hpp>
+#include <boost/random/random_device.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <exception>
+
+
+namespace
+{
+	const std::size_t TIMER_WHEEL_SLOTS = 64;
+	const std::size_t COMPLETION_RING_SIZE = 8192;
+
+	struct OlderSequence {
+		template <typename T> bool operator()(const T &a, const T &b) const
+		{
+			return a.sequence < b.sequence;
+		}
+	};
+
+	unsigned long long randomEpoch()
+	// Falls back to time if random_device is unavailable
+	{
+		try
+		{
+			boost::random::random_device rd;
+			return ((static_cast<unsigned long long>(rd()) << 32) | rd()) & 0xFFFFFFFFFFFFull;
+		}
+		catch (std::exception&)
+		{
+			return static_cast<unsigned long long>(std::time(0));
+		}
+	}
+}
+
+
+ResultStore::ResultStore(const std::size_t &num_of_shards) : completion_ring(COMPLETION_RING_SIZE), completion_head(0), completion_epoch(randomEpoch()), timer_wheel(TIMER_WHEEL_SLOTS), current_tick(0), next_sequence(0), resident_bytes(0), evicted_results(0), ttl_ticks(0), max_bytes(0), eviction_running(false)
+{
+	for (std::size_t i = 0; i < ((num_of_shards > 0) ? num_of_shards : 1); ++i)
+	{
+		shards.push_back(boost::shared_ptr<Shard>(new Shard()));
+	}
+}
+
+
+ResultStore::~ResultStore()
+{
+	stopEviction();
+	shards.clear();  // Stored results release their charge into resident_bytes, which is declared after shards
+}
+
+
+ResultStore::Shard& ResultStore::getShard(const int &unique_id)
+// Unique IDs are handed out in order, so modulo spreads them evenly
+{
+	return *shards[static_cast<unsigned int>(unique_id) % shards.size()];
+}
+
+
+void ResultStore::wait(const int &unique_id)
+{
+	Shard &shard = getShard(unique_id);
+	boost::lock_guard<boost::mutex> lock(shard.mutex);
+	StoredResult &stored_result = shard.results[unique_id];
+	stored_result.buffer.reset();
+	stored_result.offset = 0;
+	stored_result.sequence = 0;
+	stored_result.last_access = current_tick;
+}
+
+
+void ResultStore::save(const int &unique_id, const Buffer &buffer)
+{
+	{
+		const boost::shared_ptr<ResidentCharge> charge(new ResidentCharge(resident_bytes, buffer->size()));
+		Shard &shard = getShard(unique_id);
+		boost::lock_guard<boost::mutex> lock(shard.mutex);
+		storeResult(shard, unique_id, buffer, charge);
+	}
+	// Only added to ring once result can be read
+	boost::lock_guard<boost::mutex> lock(mutex_completion_ring);
+	completion_ring[completion_head % COMPLETION_RING_SIZE] = unique_id;
+	++completion_head;
+}
+
+
+void ResultStore::save(const std::vector<int> &unique_ids, const Buffer &buffer)
+// Buffer is shared by all Unique IDs, resident bytes count it once
+{
+	const boost::shared_ptr<ResidentCharge> charge(new ResidentCharge(resident_bytes, buffer->size()));
+	for (std::vector<int>::const_iterator it = unique_ids.begin(); it != unique_ids.end(); ++it)
+	{
+		Shard &shard = getShard(*it);
+		boost::lock_guard<boost::mutex> lock(shard.mutex);
+		storeResult(shard, *it, buffer, charge);
+	}
+	boost::lock_guard<boost::mutex> lock(mutex_completion_ring);
+	for (std::vector<int>::const_iterator it = unique_ids.begin(); it != unique_ids.end(); ++it)
+	{
+		completion_ring[completion_head % COMPLETION_RING_SIZE] = *it;
+		++completion_head;
+	}
+}
+
+
+void ResultStore::storeResult(Shard &shard, const int &unique_id, const Buffer &buffer, const boost::shared_ptr<ResidentCharge> &charge)
+// Shard lock must be held
+{
+	StoredResult &stored_result = shard.results[unique_id];
+	stored_result.buffer = buffer;
+	stored_result.charge = charge;
+	stored_result.offset = 0;
+	stored_result.sequence = ++next_sequence;
+	stored_result.last_access = current_tick;
+
+	if ((ttl_ticks > 0) || (max_bytes > 0))
+	{
+		const std::size_t ticks = ((ttl_ticks > 0) && (static_cast<std::size_t>(ttl_ticks) < TIMER_WHEEL_SLOTS)) ? ttl_ticks : TIMER_WHEEL_SLOTS - 1;
+		schedule(unique_id, stored_result.sequence, stored_result.last_access + ticks);
+	}
+}
+
+
+void ResultStore::eraseResult(Shard &shard, boost::unordered_map<int, StoredResult>::iterator &it)
+// Shard lock must be held, resident bytes are released with charge
+{
+	shard.results.erase(it);
+}
+
+
+ResultStore::ReadStatus ResultStore::read(const int &unique_id, char *output, const std::size_t &chunk_size)
+// Same protocol as before: chunks until all of result is sent, then one more poll returns "" + removes entry
+{
+	Shard &shard = getShard(unique_id);
+	boost::lock_guard<boost::mutex> lock(shard.mutex);
+	boost::unordered_map<int, StoredResult>::iterator it = shard.results.find(unique_id);
+	if (it == shard.results.end())
+	{
+		output[0] = '\0';
+		return UNKNOWN_ID;
+	}
+	if (!it->second.buffer)
+	{
+		std::strcpy(output, "[3]");
+		return WAITING;
+	}
+
+	const std::string &buffer = *(it->second.buffer);
+	const std::size_t remaining = buffer.size() - it->second.offset;
+	if (remaining == 0)
+	{
+		eraseResult(shard, it);
+		output[0] = '\0';
+		return FINISHED;
+	}
+
+	const std::size_t len = (remaining < chunk_size) ? remaining : chunk_size;
+	std::memcpy(output, buffer.data() + it->second.offset, len);
+	output[len] = '\0';
+	it->second.offset += len;
+	it->second.last_access = current_tick;
+	return CHUNK;
+}
+
+
+ResultStore::ReadStatus ResultStore::readWhole(const int &unique_id, Buffer &buffer, const std::size_t &max_size)
+{
+	Shard &shard = getShard(unique_id);
+	boost::lock_guard<boost::mutex> lock(shard.mutex);
+	boost::unordered_map<int, StoredResult>::iterator it = shard.results.find(unique_id);
+	if (it == shard.results.end())
+	{
+		return UNKNOWN_ID;
+	}
+	if (!it->second.buffer)
+	{
+		return WAITING;
+	}
+	if ((it->second.offset != 0) || (it->second.buffer->size() > max_size))
+	{
+		return READY;
+	}
+	buffer = it->second.buffer;
+	eraseResult(shard, it);
+	return FINISHED;
+}
+
+
+bool ResultStore::completions(const unsigned long long &epoch, unsigned long long &cursor, std::vector<int> &unique_ids, const std::size_t &max_ids)
+{
+	boost::lock_guard<boost::mutex> lock(mutex_completion_ring);
+	bool complete = true;
+	if ((epoch != completion_epoch) || (cursor > completion_head) || ((completion_head - cursor) > COMPLETION_RING_SIZE))
+	// Cursor from before a restart or IDs were overwritten
+	{
+		complete = false;
+		cursor = (completion_head > COMPLETION_RING_SIZE) ? (completion_head - COMPLETION_RING_SIZE) : 0;
+	}
+	for (; (cursor < completion_head) && (unique_ids.size() < max_ids); ++cursor)
+	{
+		unique_ids.push_back(completion_ring[cursor % COMPLETION_RING_SIZE]);
+	}
+	return complete;
+}
+
+
+unsigned long long ResultStore::completionCursor()
+{
+	boost::lock_guard<boost::mutex> lock(mutex_completion_ring);
+	return completion_head;
+}
+
+
+unsigned long long ResultStore::completionEpoch() const
+{
+	return completion_epoch;
+}
+
+
+std::size_t ResultStore::size()
+{
+	std::size_t total = 0;
+	for (std::vector< boost::shared_ptr<Shard> >::iterator it = shards.begin(); it != shards.end(); ++it)
+	{
+		boost::lock_guard<boost::mutex> lock((*it)->mutex);
+		total += (*it)->results.size();
+	}
+	return total;
+}
+
+
+std::size_t ResultStore::residentBytes() const
+{
+	return resident_bytes;
+}
+
+
+std::size_t ResultStore::evictions() const
+{
+	return evicted_results;
+}
+
+
+void ResultStore::startEviction(const int &ttl_seconds, const std::size_t &max_bytes, const EvictHandler &on_evict)
+{
+	if ((ttl_seconds <= 0) && (max_bytes == 0))
+	{
+		return;
+	}
+	this->ttl_ticks = (ttl_seconds > 0) ? ttl_seconds : 0;
+	this->max_bytes = max_bytes;
+	this->on_evict = on_evict;
+	eviction_running = true;
+	eviction_thread = boost::thread(boost::bind(&ResultStore::runEviction, this));
+}
+
+
+void ResultStore::stopEviction()
+{
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_eviction);
+		eviction_running = false;
+		cond_eviction.notify_all();
+	}
+	if (eviction_thread.joinable())
+	{
+		eviction_thread.join();
+	}
+}
+
+
+void ResultStore::schedule(const int &unique_id, const unsigned long long &sequence, const std::size_t &tick)
+{
+	TimerEntry timer_entry;
+	timer_entry.unique_id = unique_id;
+	timer_entry.sequence = sequence;
+	boost::lock_guard<boost::mutex> lock(mutex_timer_wheel);
+	timer_wheel[tick % TIMER_WHEEL_SLOTS].push_back(timer_entry);
+}
+
+
+void ResultStore::runEviction()
+{
+	std::vector<int> evicted_ids;
+	boost::unique_lock<boost::mutex> lock(mutex_eviction);
+	while (eviction_running)
+	{
+		cond_eviction.wait_for(lock, boost::chrono::seconds(1));
+		if (!eviction_running)
+		{
+			break;
+		}
+		lock.unlock();
+
+		++current_tick;
+		evicted_ids.clear();
+		evictExpired(evicted_ids);
+		if ((max_bytes > 0) && (resident_bytes > max_bytes))
+		{
+			evictOverBudget(evicted_ids);
+		}
+		// Unique IDs are freed outside of shard locks
+		for (std::vector<int>::iterator it = evicted_ids.begin(); it != evicted_ids.end(); ++it)
+		{
+			on_evict(*it);
+		}
+
+		lock.lock();
+	}
+}
+
+
+void ResultStore::evictExpired(std::vector<int> &evicted_ids)
+// Checks timer entries in slot for current tick
+//   Entry is dropped if result was already fetched, evicted if TTL passed, else rescheduled
+{
+	const std::size_t tick = current_tick;
+	std::vector<TimerEntry> timer_entries;
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_timer_wheel);
+		timer_entries.swap(timer_wheel[tick % TIMER_WHEEL_SLOTS]);
+	}
+
+	for (std::vector<TimerEntry>::iterator timer_it = timer_entries.begin(); timer_it != timer_entries.end(); ++timer_it)
+	{
+		Shard &shard = getShard(timer_it->unique_id);
+		boost::lock_guard<boost::mutex> lock(shard.mutex);
+		boost::unordered_map<int, StoredResult>::iterator it = shard.results.find(timer_it->unique_id);
+		if ((it == shard.results.end()) || (it->second.sequence != timer_it->sequence))
+		{
+			continue;
+		}
+		if ((ttl_ticks > 0) && ((it->second.last_access + ttl_ticks) <= tick))
+		{
+			eraseResult(shard, it);
+			++evicted_results;
+			evicted_ids.push_back(timer_it->unique_id);
+		}
+		else
+		{
+			std::size_t next_tick = tick + TIMER_WHEEL_SLOTS - 1;
+			if ((ttl_ticks > 0) && ((it->second.last_access + ttl_ticks) < next_tick))
+			{
+				next_tick = it->second.last_access + ttl_ticks;
+			}
+			schedule(timer_it->unique_id, timer_it->sequence, next_tick);
+		}
+	}
+}
+
+
+void ResultStore::evictOverBudget(std::vector<int> &evicted_ids)
+// Evicts oldest saved results until resident bytes are under max_bytes
+//   Only runs when over limit, timer entries are left in wheel + dropped when their slot comes round
+{
+	std::vector<TimerEntry> timer_entries;
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_timer_wheel);
+		for (std::vector< std::vector<TimerEntry> >::iterator it = timer_wheel.begin(); it != timer_wheel.end(); ++it)
+		{
+			timer_entries.insert(timer_entries.end(), it->begin(), it->end());
+		}
+	}
+	std::sort(timer_entries.begin(), timer_entries.end(), OlderSequence());
+
+	for (std::vector<TimerEntry>::iterator timer_it = timer_entries.begin(); (timer_it != timer_entries.end()) && (resident_bytes > max_bytes); ++timer_it)
+	{
+		Shard &shard = getShard(timer_it->unique_id);
+		boost::lock_guard<boost::mutex> lock(shard.mutex);
+		boost::unordered_map<int, StoredResult>::iterator it = shard.results.find(timer_it->unique_id);
+		if ((it != shard.results.end()) && (it->second.sequence == timer_it->sequence))
+		{
+			eraseResult(shard, it);
+			++evicted_results;
+			evicted_ids.push_back(timer_it->unique_id);
+		}
+	}
+}
+
+
+#ifdef TEST_RESULT_STORE_APP
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+
+// Compares polling a large result in chunks, substr copy of rest per chunk (before) versus ResultStore read offset
+//   + save / poll throughput with multiple threads, 1 shard (single lock like before) versus default shards
+namespace
+{
+	typedef boost::chrono::high_resolution_clock Clock;
+
+	// Poll loop before: copy chunk + store copy of rest back into map
+	double benchmarkLegacy(const std::string &result, const std::size_t &chunk_size, int &polls)
+	{
+		boost::unordered_map<int, std::string> unordered_map_results;
+		boost::mutex mutex_unordered_map_results;
+		std::vector<char> output(chunk_size + 1);
+
+		const Clock::time_point start = Clock::now();
+		unordered_map_results[1] = result;
+		polls = 0;
+		while (true)
+		{
+			++polls;
+			boost::lock_guard<boost::mutex> lock(mutex_unordered_map_results);
+			boost::unordered_map<int, std::string>::const_iterator it = unordered_map_results.find(1);
+			if (it->second.empty())
+			{
+				unordered_map_results.erase(1);
+				break;
+			}
+			std::string msg = it->second.substr(0, chunk_size);
+			std::strcpy(&output[0], msg.c_str());
+			if (it->second.length() > chunk_size)
+			{
+				unordered_map_results[1] = it->second.substr(chunk_size);
+			}
+			else
+			{
+				unordered_map_results[1].clear();
+			}
+		}
+		return boost::chrono::duration_cast< boost::chrono::duration<double, boost::milli> >(Clock::now() - start).count();
+	}
+
+	double benchmarkResultStore(const std::string &result, const std::size_t &chunk_size, int &polls)
+	{
+		ResultStore result_store;
+		std::vector<char> output(chunk_size + 1);
+
+		const Clock::time_point start = Clock::now();
+		result_store.save(1, ResultStore::Buffer(new std::string(result)));
+		polls = 0;
+		while (true)
+		{
+			++polls;
+			if (result_store.read(1, &output[0], chunk_size) != ResultStore::CHUNK)
+			{
+				break;
+			}
+		}
+		return boost::chrono::duration_cast< boost::chrono::duration<double, boost::milli> >(Clock::now() - start).count();
+	}
+
+	// Each thread = worker saving a small result + arma polling it, own range of Unique IDs
+	void contentionJob(ResultStore *result_store, const int first_id, const int num_of_ids)
+	{
+		const ResultStore::Buffer buffer(new std::string("[1,[1,\"76561197960287930\",[1,2,3]]]"));
+		char output[128];
+		for (int unique_id = first_id; unique_id < (first_id + num_of_ids); ++unique_id)
+		{
+			result_store->wait(unique_id);
+			result_store->read(unique_id, output, 100);
+			result_store->save(unique_id, buffer);
+			while (result_store->read(unique_id, output, 100) == ResultStore::CHUNK)
+			{
+			}
+		}
+	}
+
+	double benchmarkContention(const std::size_t &num_of_shards, const int &num_of_threads, const int &ids_per_thread)
+	{
+		ResultStore result_store(num_of_shards);
+		boost::thread_group threads;
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < num_of_threads; ++i)
+		{
+			threads.create_thread(boost::bind(&contentionJob, &result_store, (i * ids_per_thread), ids_per_thread));
+		}
+		threads.join_all();
+		const double seconds = boost::chrono::duration_cast< boost::chrono::duration<double> >(Clock::now() - start).count();
+		return (num_of_threads * ids_per_thread) / seconds;
+	}
+}
+
+
+int main(int nNumberofArgs, char* pszArgs[])
+{
+	const std::size_t chunk_size = 10239 - 9;  // Arma3 outputSize - 1 - space for [2,"ID"] etc
+	const std::size_t result_sizes[] = {100 * 1024, 1024 * 1024, 2 * 1024 * 1024, 10 * 1024 * 1024};
+	for (std::size_t i = 0; i < (sizeof(result_sizes) / sizeof(result_sizes[0])); ++i)
+	{
+		const std::string result(result_sizes[i], 'x');
+		int legacy_polls;
+		int store_polls;
+		const double legacy_ms = benchmarkLegacy(result, chunk_size, legacy_polls);
+		const double store_ms = benchmarkResultStore(result, chunk_size, store_polls);
+		std::cout << "Result Size: " << (result_sizes[i] / 1024) << " KB  Polls: " << legacy_polls << "/" << store_polls;
+		std::cout << "  substr: " << legacy_ms << " ms  ResultStore: " << store_ms << " ms" << std::endl;
+	}
+
+	const int ids_per_thread = 200000;
+	const int thread_counts[] = {1, 2, 4, 8, 16};
+	for (std::size_t i = 0; i < (sizeof(thread_counts) / sizeof(thread_counts[0])); ++i)
+	{
+		std::cout << "Threads: " << thread_counts[i];
+		std::cout << "  results/sec 1 shard: " << static_cast<long long>(benchmarkContention(1, thread_counts[i], ids_per_thread));
+		std::cout << "  16 shards: " << static_cast<long long>(benchmarkContention(16, thread_counts[i], ids_per_thread)) << std::endl;
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,152 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+class ResultStore
+// Stored Results for Unique IDs, waiting on a job or to long for arma outputsize
+//   Result is stored once as an immutable buffer + read offset per Unique ID
+//   Each 5:ID poll only copies the chunk it returns, buffer can be shared by multiple Unique IDs (Coalesced Calls)
+//   Split into shards by Unique ID, each shard has its own lock. So worker threads saving results + arma polling don't all fight over one lock
+//   Optional eviction of results never fetched (i.e player disconnected), checked once a second via a timer wheel
+//     TTL = seconds since result was saved / last polled, Max Bytes = evicts oldest results once resident bytes are over limit
+//     Waiting entries are never evicted, job still owns the Unique ID
+{
+	public:
+		typedef boost::shared_ptr<const std::string> Buffer;
+		typedef boost::function<void(const int &unique_id)> EvictHandler;
+
+		ResultStore(const std::size_t &num_of_shards = 16);
+		~ResultStore();
+
+		// ttl_seconds / max_bytes 0 = Disabled, on_evict is called for each evicted Unique ID (from timer thread)
+		void startEviction(const int &ttl_seconds, const std::size_t &max_bytes, const EvictHandler &on_evict);
+		void stopEviction();
+
+		enum ReadStatus {
+			UNKNOWN_ID, // No Unique ID
+			WAITING,    // Job not finished yet
+			CHUNK,      // Part of Result copied to output
+			FINISHED,   // All of Result was sent already, entry is removed (caller frees Unique ID)
+			READY       // Result saved but to big for readWhole, fetch with read
+		};
+
+		void wait(const int &unique_id);
+		void save(const int &unique_id, const Buffer &buffer);
+		void save(const std::vector<int> &unique_ids, const Buffer &buffer);
+
+		// Copies next chunk of upto chunk_size chars into output (null terminated)
+		ReadStatus read(const int &unique_id, char *output, const std::size_t &chunk_size);
+
+		// Takes whole Result if nothing was read yet + it fits in max_size, entry is removed (FINISHED, caller frees Unique ID)
+		ReadStatus readWhole(const int &unique_id, Buffer &buffer, const std::size_t &max_size);
+
+		// Completion Ring -- Unique IDs in order results were saved, so arma can ask what finished since last poll
+		//   cursor = count of saves seen so far, gets moved past returned IDs
+		//   epoch = random per process, cursor from another process (before a restart) never matches this ring
+		//   Returns false if epoch differs or cursor is older than ring (IDs were missed, poll outstanding IDs with 6:ID:ID)
+		bool completions(const unsigned long long &epoch, unsigned long long &cursor, std::vector<int> &unique_ids, const std::size_t &max_ids);
+		unsigned long long completionCursor();
+		unsigned long long completionEpoch() const;
+
+		std::size_t size();
+		std::size_t residentBytes() const;
+		std::size_t evictions() const;
+
+	private:
+		struct ResidentCharge : private boost::noncopyable
+		// Bytes of one saved Buffer, shared by every Unique ID it was saved for (Coalesced Calls) so it's counted once
+		//   Bytes are released once last Unique ID holding it is erased / saved over
+		{
+			ResidentCharge(boost::atomic<std::size_t> &resident_bytes, const std::size_t &bytes) : resident_bytes(resident_bytes), bytes(bytes)
+			{
+				resident_bytes += bytes;
+			}
+			~ResidentCharge()
+			{
+				resident_bytes -= bytes;
+			}
+
+			boost::atomic<std::size_t> &resident_bytes;
+			const std::size_t bytes;
+		};
+
+		struct StoredResult {
+			Buffer buffer;       // NULL = Waiting
+			boost::shared_ptr<ResidentCharge> charge;
+			std::size_t offset;  // Next char to send
+			unsigned long long sequence;  // Increases with every save, tells timer entries apart when a Unique ID is reused
+			std::size_t last_access;      // Tick of save / last poll
+		};
+		struct Shard {
+			boost::mutex mutex;
+			boost::unordered_map<int, StoredResult> results;
+			char padding[64];  // Keep shard locks on separate cache lines
+		};
+		std::vector< boost::shared_ptr<Shard> > shards;
+
+		Shard& getShard(const int &unique_id);
+
+		std::vector<int> completion_ring;
+		unsigned long long completion_head;  // Total saves, next save goes into completion_ring[completion_head % size]
+		unsigned long long completion_epoch;
+		boost::mutex mutex_completion_ring;
+
+		void storeResult(Shard &shard, const int &unique_id, const Buffer &buffer, const boost::shared_ptr<ResidentCharge> &charge);
+		void eraseResult(Shard &shard, boost::unordered_map<int, StoredResult>::iterator &it);
+
+		// Timer Wheel -- one slot per tick (second), entry is checked when its slot comes round + rescheduled if still alive
+		struct TimerEntry {
+			int unique_id;
+			unsigned long long sequence;
+		};
+		std::vector< std::vector<TimerEntry> > timer_wheel;
+		boost::mutex mutex_timer_wheel;
+
+		boost::atomic<std::size_t> current_tick;
+		boost::atomic<unsigned long long> next_sequence;
+		boost::atomic<std::size_t> resident_bytes;
+		boost::atomic<std::size_t> evicted_results;
+
+		int ttl_ticks;
+		std::size_t max_bytes;
+		EvictHandler on_evict;
+		bool eviction_running;
+		boost::mutex mutex_eviction;
+		boost::condition_variable cond_eviction;
+		boost::thread eviction_thread;
+
+		void schedule(const int &unique_id, const unsigned long long &sequence, const std::size_t &tick);
+		void runEviction();
+		void evictExpired(std::vector<int> &evicted_ids);
+		void evictOverBudget(std::vector<int> &evicted_ids);
+};
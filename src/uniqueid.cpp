@@ -2,103 +2,252 @@
 
 
 #include <boost/random/mersenne_twister.hpp>
+#include <boost/random/random_device.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 
-#include <boost/numeric/interval.hpp>
-#include <limits>
-#include <set>
-#include <iostream>
-#include <string>
+#include <ctime>
+#include <exception>
 
 #include "uniqueid.h"
 
 
-IdManager::IdManager()
+namespace
+{
+	// 65535 IDs in use at once, same window as before. Slot 0 is never used, so 0 = end of free list + ID is never 0
+	const boost::uint32_t SLOT_BITS = 16;
+	const boost::uint32_t NUM_OF_SLOTS = (1u << SLOT_BITS);
+	// Keeps ID positive, 15 bits so a stale ID only matches again after its slot is reused 32768 times
+	const boost::uint32_t GENERATION_MASK = 0x7FFF;
+	const boost::uint64_t SLOT_MASK = 0xFFFFFFFFull;
+	const boost::uint64_t TAG_INCREMENT = (1ull << 32);
+}
+
+
+IdManager::IdManager() : slots_(new Slot[NUM_OF_SLOTS])
 {
-	// Smaller Range of Unique ID 65536 is still loads
 	#ifdef TEST_APP
 		// Normal ID for Test APP, easier to work with if ID =! random
-		free_.insert(id_interval(1, std::numeric_limits<int>::max()));
+		const boost::uint32_t start_generation = 0;
 	#else
-		// Randomize Starting Unique ID
-		boost::random::mt19937 gen;
-		boost::random::uniform_int_distribution<> dist(1, (std::numeric_limits<int>::max()-65536));
-		const int seed = dist(gen);
-		free_.insert(id_interval(seed, (seed + 65536)));
+		// Randomize Starting Generation, so Unique IDs differ from last server restart
+		//   Default seeded mt19937 returns same number every start, seed from random_device (time if unavailable)
+		boost::uint32_t seed;
+		try
+		{
+			boost::random::random_device rd;
+			seed = rd();
+		}
+		catch (std::exception&)
+		{
+			seed = static_cast<boost::uint32_t>(std::time(0));
+		}
+		boost::random::mt19937 gen(seed);
+		boost::random::uniform_int_distribution<> dist(0, GENERATION_MASK);
+		const boost::uint32_t start_generation = dist(gen) * 2;
 	#endif
-}
 
-int IdManager::AllocateId()
-{
-	id_interval first = *(free_.begin());
-	int free_id = first.left();
-	free_.erase(free_.begin());
-	if (first.left() + 1 <= first.right()) {
-		free_.insert(id_interval(first.left() + 1 , first.right()));
+	for (boost::uint32_t slot = 0; slot < NUM_OF_SLOTS; ++slot)
+	{
+		slots_[slot].next = ((slot + 1) < NUM_OF_SLOTS) ? (slot + 1) : 0;
+		slots_[slot].generation = start_generation;
 	}
-	return free_id;
+	free_head_ = 1;
 }
 
-bool IdManager::MarkAsUsed(int id)
+int IdManager::AllocateId()
 {
-	id_intervals_t::iterator it = free_.find(id_interval(id,id));
-	if (it == free_.end()) {
-		return false;
-	} else {
-		id_interval free_interval = *(it);
-		//free_.erase (it);
-		if (free_interval.left() < id) {
-			free_.insert(id_interval(free_interval.left(), id-1));
-			free_.insert(it, id_interval(free_interval.left(), id-1));
+	boost::uint64_t head = free_head_.load(boost::memory_order_acquire);
+	boost::uint32_t slot;
+	while (true)
+	{
+		slot = static_cast<boost::uint32_t>(head & SLOT_MASK);
+		if (slot == 0)
+		{
+			return -1;
 		}
-		if (id +1 <= free_interval.right() ) {
-			free_.insert(id_interval(id+1, free_interval.right()));
-			free_.insert(it, id_interval(id+1, free_interval.right()));
+		const boost::uint64_t new_head = ((head & ~SLOT_MASK) + TAG_INCREMENT) | slots_[slot].next.load(boost::memory_order_relaxed);
+		if (free_head_.compare_exchange_weak(head, new_head, boost::memory_order_acquire, boost::memory_order_acquire))
+		{
+			break;
 		}
-		return true;
 	}
+	const boost::uint32_t generation = slots_[slot].generation.fetch_add(1, boost::memory_order_acq_rel) + 1;
+	return static_cast<int>((((generation >> 1) & GENERATION_MASK) << SLOT_BITS) | slot);
 }
 
 void IdManager::FreeId(int id)
 {
-	id_intervals_t::iterator it = free_.find(id_interval(id,id));
-	if (it != free_.end()  && it->left() <= id && it->right() > id) {
-		return ;
+	if (id <= 0)
+	{
+		return;
+	}
+	const boost::uint32_t slot = static_cast<boost::uint32_t>(id) & (NUM_OF_SLOTS - 1);
+	if (slot == 0)
+	{
+		return;
+	}
+
+	// Only frees if slot is in use with same generation as id, generation change also stops a double free
+	boost::uint32_t generation = slots_[slot].generation.load(boost::memory_order_acquire);
+	if (((generation & 1) == 0) || (((generation >> 1) & GENERATION_MASK) != (static_cast<boost::uint32_t>(id) >> SLOT_BITS)))
+	{
+		return;
+	}
+	if (!slots_[slot].generation.compare_exchange_strong(generation, generation + 1, boost::memory_order_acq_rel))
+	{
+		return;
 	}
-	it = free_.upper_bound(id_interval(id,id));
-	if (it == free_.end()) {
-		return ;
-	} else {
-		id_interval free_interval = *(it);
-
-		if (id + 1 != free_interval.left()) {
-			free_.insert(id_interval(id, id));
-		} else {
-			if (it != free_.begin()) {
+
+	boost::uint64_t head = free_head_.load(boost::memory_order_relaxed);
+	boost::uint64_t new_head;
+	do
+	{
+		slots_[slot].next.store(static_cast<boost::uint32_t>(head & SLOT_MASK), boost::memory_order_relaxed);
+		new_head = ((head & ~SLOT_MASK) + TAG_INCREMENT) | slot;
+	} while (!free_head_.compare_exchange_weak(head, new_head, boost::memory_order_release, boost::memory_order_relaxed));
+}
+
+
+#ifdef TEST_UNIQUEID_APP
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/numeric/interval.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iostream>
+#include <limits>
+#include <set>
+#include <vector>
+
+// Compares allocate / free throughput, IdManager versus interval set + mutex it replaced
+namespace
+{
+	class id_interval
+	{
+	public:
+		id_interval(int ll, int uu) : value_(ll,uu)  {}
+		bool operator < (const id_interval& s) const
+		{
+			return (value_.lower() < s.value_.lower()) && (value_.upper() < s.value_.lower());
+		}
+		int left() const { return value_.lower(); }
+		int right() const {  return value_.upper(); }
+	private:
+		boost::numeric::interval<int> value_;
+	};
+
+	class LegacyIdManager {
+	public:
+		LegacyIdManager()
+		{
+			free_.insert(id_interval(1, 65536));
+		}
+		int AllocateId()
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_unique_id);
+			id_interval first = *(free_.begin());
+			int free_id = first.left();
+			free_.erase(free_.begin());
+			if (first.left() + 1 <= first.right()) {
+				free_.insert(id_interval(first.left() + 1 , first.right()));
+			}
+			return free_id;
+		}
+		void FreeId(int id)
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_unique_id);
+			id_intervals_t::iterator it = free_.find(id_interval(id,id));
+			if (it != free_.end()  && it->left() <= id && it->right() > id) {
+				return ;
+			}
+			it = free_.upper_bound(id_interval(id,id));
+			if (it == free_.end()) {
+				return ;
+			}
+			id_interval free_interval = *(it);
+			if (id + 1 != free_interval.left()) {
+				free_.insert(id_interval(id, id));
+			} else if (it != free_.begin()) {
 				id_intervals_t::iterator it_2 = it;
 				--it_2;
 				if (it_2->right() + 1 == id ) {
 					id_interval free_interval_2 = *(it_2);
 					free_.erase(it);
 					free_.erase(it_2);
-					free_.insert(
-						id_interval(free_interval_2.left(), 
-									free_interval.right()));
+					free_.insert(id_interval(free_interval_2.left(), free_interval.right()));
 				} else {
 					free_.erase(it);
 					free_.insert(id_interval(id, free_interval.right()));
 				}
 			} else {
-					free_.erase(it);
-					free_.insert(id_interval(id, free_interval.right()));
+				free_.erase(it);
+				free_.insert(id_interval(id, free_interval.right()));
+			}
+		}
+	private:
+		typedef std::set<id_interval> id_intervals_t;
+		id_intervals_t free_;
+		boost::mutex mutex_unique_id;
+	};
+
+	// Each thread keeps a window of IDs in use (like outstanding tickets) + frees them out of order
+	template <typename T> void allocateJob(T *manager, const int iterations)
+	{
+		std::vector<int> ids(64, -1);
+		for (int i = 0; i < iterations; ++i)
+		{
+			int &id = ids[(i * 7) % ids.size()];
+			if (id != -1)
+			{
+				manager->FreeId(id);
 			}
+			id = manager->AllocateId();
+		}
+		for (std::vector<int>::iterator it = ids.begin(); it != ids.end(); ++it)
+		{
+			manager->FreeId(*it);
+		}
+	}
+
+	template <typename T> double benchmark(const int &num_of_threads, const int &iterations)
+	{
+		T manager;
+		boost::thread_group threads;
+		const boost::chrono::high_resolution_clock::time_point start = boost::chrono::high_resolution_clock::now();
+		for (int i = 0; i < num_of_threads; ++i)
+		{
+			threads.create_thread(boost::bind(&allocateJob<T>, &manager, iterations));
 		}
+		threads.join_all();
+		const double seconds = boost::chrono::duration_cast< boost::chrono::duration<double> >(boost::chrono::high_resolution_clock::now() - start).count();
+		return (num_of_threads * iterations) / seconds;
 	}
 }
 
-bool id_interval::operator < (const id_interval& s) const
+
+int main(int nNumberofArgs, char* pszArgs[])
 {
-	return 
-	  (value_.lower() < s.value_.lower()) && 
-	  (value_.upper() < s.value_.lower());
-}
\ No newline at end of file
+	// Stale ID check
+	IdManager mgr;
+	const int first_id = mgr.AllocateId();
+	mgr.FreeId(first_id);
+	const int second_id = mgr.AllocateId();
+	mgr.FreeId(first_id);  // Stale, must be ignored
+	const int third_id = mgr.AllocateId();
+	std::cout << "Stale ID check: " << first_id << " " << second_id << " " << third_id;
+	std::cout << (((first_id != second_id) && (third_id != second_id)) ? " OK" : " FAILED") << std::endl;
+
+	const int iterations = 1000000;
+	const int thread_counts[] = {1, 2, 4, 8, 16};
+	for (std::size_t i = 0; i < (sizeof(thread_counts) / sizeof(thread_counts[0])); ++i)
+	{
+		std::cout << "Threads: " << thread_counts[i];
+		std::cout << "  ids/sec interval set + mutex: " << static_cast<long long>(benchmark<LegacyIdManager>(thread_counts[i], iterations));
+		std::cout << "  lock free: " << static_cast<long long>(benchmark<IdManager>(thread_counts[i], iterations)) << std::endl;
+	}
+	return 0;
+}
+#endif
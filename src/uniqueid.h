@@ -1,33 +1,28 @@
 //http://stackoverflow.com/questions/2620218/fastest-container-or-algorithm-for-unique-reusable-ids-in-c
+//  Replaced interval set with lock free slab + free list, IDs carry a 15 bit generation
+//    A stale ID won't match a reused slot until that slot has been reused 32768 times (ID has to fit in a positive int)
 
 
 #pragma once
 
-#include <boost/numeric/interval.hpp>
-#include <limits>
-#include <set>
-#include <iostream>
-#include <string>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_array.hpp>
 
 
-class id_interval 
-{
-public:
-	id_interval(int ll, int uu) : value_(ll,uu)  {}
-	bool operator < (const id_interval& ) const;
-	int left() const { return value_.lower(); }
-	int right() const {  return value_.upper(); }
-private:
-	boost::numeric::interval<int> value_;
-};
-
 class IdManager {
 public:
 	IdManager();
-	int AllocateId();          // Allocates an id
-	void FreeId(int id);       // Frees an id so it can be used again
-	bool MarkAsUsed(int id);   // Let's the user register an id. 
-private: 
-	typedef std::set<id_interval> id_intervals_t;
-	id_intervals_t free_;
-};
\ No newline at end of file
+	int AllocateId();          // Allocates an id, returns -1 if all ids are in use
+	void FreeId(int id);       // Frees an id so it can be used again, stale / unknown ids are ignored
+private:
+	// ID = (generation << SLOT_BITS) | slot, generation is bumped on every free
+	struct Slot {
+		boost::atomic<boost::uint32_t> next;        // Next free slot, only valid while slot is in free list
+		boost::atomic<boost::uint32_t> generation;  // Odd = in use, Even = free, ID holds (generation >> 1) & 0x7FFF
+	};
+	boost::scoped_array<Slot> slots_;
+
+	// Treiber stack of free slots, head = (tag << 32) | slot. Tag is bumped on every pop to stop ABA
+	boost::atomic<boost::uint64_t> free_head_;
+};
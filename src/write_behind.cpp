@@ -0,0 +1,194 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "write_behind.h"
+
+#include <boost/thread/lock_guard.hpp>
+
+
+WriteBehindQueue::WriteBehindQueue(const std::string &protocol_name, const std::size_t &flush_size, const int &flush_delay) : protocol_name(protocol_name), flush_size(flush_size), flush_delay(flush_delay)
+{
+}
+
+
+bool WriteBehindQueue::add(const std::string &data, Batch &full_batch, bool &first_call)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	first_call = !calls;
+	if (first_call)
+	{
+		calls.reset(new std::vector<std::string>());
+		calls->reserve(flush_size);
+		first_call_time = boost::chrono::steady_clock::now();
+	}
+	calls->push_back(data);
+	if (calls->size() >= flush_size)
+	{
+		full_batch.swap(calls);
+		calls.reset();
+		return true;
+	}
+	return false;
+}
+
+
+bool WriteBehindQueue::takeDue(const boost::chrono::steady_clock::time_point &now, Batch &due_batch, boost::chrono::steady_clock::time_point &next_due)
+// next_due is only lowered, caller passes earliest due time found so far
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (!calls)
+	{
+		return false;
+	}
+	const boost::chrono::steady_clock::time_point due = first_call_time + flush_delay;
+	if (due > now)
+	{
+		if (due < next_due)
+		{
+			next_due = due;
+		}
+		return false;
+	}
+	due_batch.swap(calls);
+	calls.reset();
+	return true;
+}
+
+
+bool WriteBehindQueue::take(Batch &batch)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (!calls)
+	{
+		return false;
+	}
+	batch.swap(calls);
+	calls.reset();
+	return true;
+}
+
+
+const std::string& WriteBehindQueue::protocolName() const
+{
+	return protocol_name;
+}
+
+
+GroupCommitQueue::GroupCommitQueue(const std::string &protocol_name, const std::size_t &max_size, const int &delay) : calls(new std::vector<Call>()), committing(false), scheduled(false), protocol_name(protocol_name), max_size(max_size), commit_delay(delay)
+{
+}
+
+
+bool GroupCommitQueue::add(const std::string &data, const int &unique_id)
+{
+	Call call;
+	call.data = data;
+	call.unique_id = unique_id;
+
+	boost::lock_guard<boost::mutex> lock(mutex);
+	calls->push_back(call);
+	if (committing)
+	{
+		return false;
+	}
+	committing = true;
+	return true;
+}
+
+
+void GroupCommitQueue::take(Batch &batch)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (calls->size() <= max_size)
+	{
+		batch.swap(calls);
+		calls.reset(new std::vector<Call>());
+	}
+	else
+	{
+		batch.reset(new std::vector<Call>(calls->begin(), calls->begin() + max_size));
+		calls->erase(calls->begin(), calls->begin() + max_size);
+	}
+}
+
+
+bool GroupCommitQueue::finish()
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	committing = !calls->empty();
+	return committing;
+}
+
+
+void GroupCommitQueue::abandon(Batch &batch)
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	batch.swap(calls);
+	calls.reset(new std::vector<Call>());
+	committing = false;
+}
+
+
+void GroupCommitQueue::schedule()
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	scheduled = true;
+	commit_due = boost::chrono::steady_clock::now() + commit_delay;
+}
+
+
+bool GroupCommitQueue::takeDue(const boost::chrono::steady_clock::time_point &now, boost::chrono::steady_clock::time_point &next_due)
+// next_due is only lowered, caller passes earliest due time found so far
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	if (!scheduled)
+	{
+		return false;
+	}
+	if (commit_due > now)
+	{
+		if (commit_due < next_due)
+		{
+			next_due = commit_due;
+		}
+		return false;
+	}
+	scheduled = false;
+	return true;
+}
+
+
+bool GroupCommitQueue::takeScheduled()
+{
+	boost::lock_guard<boost::mutex> lock(mutex);
+	const bool was_scheduled = scheduled;
+	scheduled = false;
+	return was_scheduled;
+}
+
+
+const std::string& GroupCommitQueue::protocolName() const
+{
+	return protocol_name;
+}
+
+
+const boost::chrono::milliseconds& GroupCommitQueue::delay() const
+{
+	return commit_delay;
+}
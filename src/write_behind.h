@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2014 Declan Ireland <http://github.com/torndeco/extDB>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/chrono.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+class WriteBehindQueue
+// Collects 1: calls of a WriteBehind Protocol, calls are flushed as one batch (one Session + one Transaction)
+//   Batch is taken once Flush Size calls are queued (arma main thread) or Flush Delay ms after its first call (flush thread)
+//   So a call waits at most Flush Delay before its batch is queued on the Worker Lane
+{
+	public:
+		typedef boost::shared_ptr< std::vector<std::string> > Batch;
+
+		WriteBehindQueue(const std::string &protocol_name, const std::size_t &flush_size, const int &flush_delay);
+
+		bool add(const std::string &data, Batch &full_batch, bool &first_call);  // true = batch is full, caller flushes full_batch
+		bool takeDue(const boost::chrono::steady_clock::time_point &now, Batch &due_batch, boost::chrono::steady_clock::time_point &next_due);
+		bool take(Batch &batch);  // Takes batch even if not due, i.e on shutdown
+
+		const std::string& protocolName() const;
+
+	private:
+		boost::mutex mutex;
+		Batch calls;
+		boost::chrono::steady_clock::time_point first_call_time;
+
+		const std::string protocol_name;
+		const std::size_t flush_size;
+		const boost::chrono::milliseconds flush_delay;
+};
+
+
+class GroupCommitQueue
+// Collects 2: calls of a GroupCommit Protocol, calls waiting at the same time share one transaction + commit
+//   First call queues a commit job, calls arriving while that job is queued / committing join the next batch
+//   So batches grow with load (i.e SQLite fsync time) instead of waiting on a fixed timer
+//   With GroupCommitDelay the commit job is scheduled instead, flush thread queues it once delay passed
+{
+	public:
+		struct Call {
+			std::string data;
+			int unique_id;
+		};
+		typedef boost::shared_ptr< std::vector<Call> > Batch;
+
+		GroupCommitQueue(const std::string &protocol_name, const std::size_t &max_size, const int &delay);
+
+		bool add(const std::string &data, const int &unique_id);  // true = no commit job queued, caller queues one
+		void take(Batch &batch);  // Only called from commit job, takes up to max_size calls
+		bool finish();            // true = more calls waiting, commit job queues itself again
+		void abandon(Batch &batch);  // Takes all waiting calls + clears commit job flag, caller resolves their tickets
+
+		void schedule();  // Commit job is due GroupCommitDelay from now
+		bool takeDue(const boost::chrono::steady_clock::time_point &now, boost::chrono::steady_clock::time_point &next_due);
+		bool takeScheduled();  // Takes scheduled commit job even if not due, i.e on shutdown
+
+		const std::string& protocolName() const;
+		const boost::chrono::milliseconds& delay() const;
+
+	private:
+		boost::mutex mutex;
+		Batch calls;
+		bool committing;
+		bool scheduled;
+		boost::chrono::steady_clock::time_point commit_due;
+
+		const std::string protocol_name;
+		const std::size_t max_size;
+		const boost::chrono::milliseconds commit_delay;
+};